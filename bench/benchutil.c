@@ -0,0 +1,285 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+/* Helpers shared by the benchmark tools */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+
+#include "benchutil.h"
+
+const char *bench_name = "bench";
+
+void die(const char *what)
+{
+		fprintf(stderr, "%s: %s: %s\n", bench_name, what, strerror(errno));
+		exit(EXIT_FAILURE);
+}
+
+uint64_t now_ns(void)
+{
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int parse_addr(const char *str, struct sockaddr_in *addr)
+{
+		char host[32], *colon;
+
+		strncpy(host, str, sizeof(host) - 1);
+		host[sizeof(host) - 1] = '\0';
+		colon = strchr(host, ':');
+		if (!colon) {
+				return -1;
+		}
+
+		*colon = '\0';
+		memset(addr, 0, sizeof(*addr));
+		addr->sin_family = AF_INET;
+		addr->sin_port = htons(atoi(colon + 1));
+		return (inet_pton(AF_INET, host, &addr->sin_addr) == 1) ? 0 : -1;
+}
+
+/* Thousands of flows need more descriptors than the usual soft limit */
+int raise_nofile(void)
+{
+		struct rlimit rl;
+
+		if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+				die("getrlimit");
+		}
+
+		rl.rlim_cur = rl.rlim_max;
+		if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > BENCH_MAX_FDS) {
+				rl.rlim_cur = BENCH_MAX_FDS;
+		}
+		setrlimit(RLIMIT_NOFILE, &rl);
+		return (int)rl.rlim_cur;
+}
+
+void set_nonblock(int fd)
+{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+void epoll_add(int epfd, int fd, uint32_t events)
+{
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = events;
+		ev.data.fd = fd;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+				die("epoll_ctl");
+		}
+}
+
+/* User + system CPU time in seconds from the stat file @path */
+static double stat_cpu(const char *path)
+{
+		char line[1024], *p;
+		unsigned long utime, stime;
+		FILE *f;
+
+		f = fopen(path, "r");
+		if (!f) {
+				return -1;
+		}
+		p = fgets(line, sizeof(line), f) ? strrchr(line, ')') : NULL;
+		fclose(f);
+		if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+								&utime, &stime) != 2) {
+				return -1;
+		}
+
+		return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/* User + system CPU time of process @pid in seconds, -1 if unknown */
+double proc_cpu(pid_t pid)
+{
+		char path[64];
+
+		if (pid <= 0) {
+				return -1;
+		}
+
+		snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+		return stat_cpu(path);
+}
+
+/*
+ * CPU time in seconds of the threads of process @pid named @comm,
+ * -1 if there's none.
+ */
+double proc_thread_cpu(pid_t pid, const char *comm)
+{
+		char path[512], name[64];
+		struct dirent *de;
+		double cpu, total = -1;
+		DIR *dir;
+		FILE *f;
+
+		if (pid <= 0) {
+				return -1;
+		}
+
+		snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+		dir = opendir(path);
+		if (!dir) {
+				return -1;
+		}
+		while ((de = readdir(dir))) {
+				if (de->d_name[0] == '.') {
+						continue;
+				}
+
+				snprintf(path, sizeof(path), "/proc/%d/task/%s/comm", (int)pid,
+								de->d_name);
+				f = fopen(path, "r");
+				if (!f) {
+						continue;
+				}
+				if (!fgets(name, sizeof(name), f)) {
+						name[0] = '\0';
+				}
+				fclose(f);
+				name[strcspn(name, "\n")] = '\0';
+				if (strcmp(name, comm)) {
+						continue;
+				}
+
+				snprintf(path, sizeof(path), "/proc/%d/task/%s/stat", (int)pid,
+								de->d_name);
+				cpu = stat_cpu(path);
+				if (cpu >= 0) {
+						total = (total < 0) ? cpu : total + cpu;
+				}
+		}
+		closedir(dir);
+
+		return total;
+}
+
+/* Memory of all TCP sockets of the system in KB, -1 if unknown */
+long sockstat_tcp_mem(void)
+{
+		char line[256];
+		long pages = -1;
+		FILE *f;
+
+		f = fopen("/proc/net/sockstat", "r");
+		if (!f) {
+				return -1;
+		}
+		while (fgets(line, sizeof(line), f)) {
+				if (sscanf(line, "TCP: inuse %*d orphan %*d tw %*d alloc %*d mem %ld",
+										&pages) == 1) {
+						break;
+				}
+		}
+		fclose(f);
+
+		return (pages < 0) ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Resident set size of process @pid in KB, -1 if unknown */
+long proc_rss(pid_t pid)
+{
+		char path[64], line[256];
+		long rss = -1;
+		FILE *f;
+
+		if (pid <= 0) {
+				return -1;
+		}
+
+		snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+		f = fopen(path, "r");
+		if (!f) {
+				return -1;
+		}
+		while (fgets(line, sizeof(line), f)) {
+				if (sscanf(line, "VmRSS: %ld kB", &rss) == 1) {
+						break;
+				}
+		}
+		fclose(f);
+
+		return rss;
+}
+
+int listen_on(struct sockaddr_in *addr)
+{
+		int fd, optval = 1;
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) {
+				die("socket");
+		}
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+		if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0) {
+				die("bind");
+		}
+		if (listen(fd, 4096) < 0) {
+				die("listen");
+		}
+		set_nonblock(fd);
+
+		return fd;
+}
+
+void samples_add(struct samples *s, uint64_t val)
+{
+		if (s->n == s->size) {
+				s->size = s->size ? s->size * 2 : 4096;
+				s->val = realloc(s->val, s->size * sizeof(*s->val));
+				if (!s->val) {
+						die("realloc");
+				}
+		}
+
+		s->val[s->n++] = val;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+		uint64_t ua = *(const uint64_t *)a, ub = *(const uint64_t *)b;
+
+		return (ua > ub) - (ua < ub);
+}
+
+/* Print percentiles of @s in microseconds as a JSON object */
+void samples_print_json(struct samples *s)
+{
+		size_t n = s->n;
+
+		if (!n) {
+				printf("{\"count\":0}");
+				return;
+		}
+
+		qsort(s->val, n, sizeof(*s->val), cmp_u64);
+		printf("{\"count\":%zu,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+						"\"p999\":%.1f,\"max\":%.1f}", n, s->val[n / 2] / 1e3,
+						s->val[n * 9 / 10] / 1e3, s->val[n * 99 / 100] / 1e3,
+						s->val[n * 999 / 1000] / 1e3, s->val[n - 1] / 1e3);
+}
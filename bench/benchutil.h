@@ -0,0 +1,44 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __BENCHUTIL_H
+#define __BENCHUTIL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+/* Never size per-descriptor tables for more than that */
+#define BENCH_MAX_FDS  (1 << 20)
+
+/* Latency samples in nanoseconds */
+struct samples {
+		uint64_t *val;
+		size_t n;
+		size_t size;
+};
+
+/* Program name used in error messages */
+extern const char *bench_name;
+
+void die(const char *what) __attribute__((noreturn));
+uint64_t now_ns(void);
+int parse_addr(const char *str, struct sockaddr_in *addr);
+int raise_nofile(void);
+void set_nonblock(int fd);
+void epoll_add(int epfd, int fd, uint32_t events);
+int listen_on(struct sockaddr_in *addr);
+double proc_cpu(pid_t pid);
+double proc_thread_cpu(pid_t pid, const char *comm);
+long sockstat_tcp_mem(void);
+long proc_rss(pid_t pid);
+void samples_add(struct samples *s, uint64_t val);
+void samples_print_json(struct samples *s);
+
+#endif /* __BENCHUTIL_H */
@@ -0,0 +1,403 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+/*
+ * linkem: userspace emulation of a satellite link for the benchmarks.
+ * It accepts TCP connections, connects each of them to a fixed target
+ * and relays both directions through a delay line with the given RTT,
+ * jitter, bandwidth and loss, without tc/netem privileges.
+ *
+ * linkem terminates TCP on both sides, so the end hosts' congestion
+ * control never sees the emulated path: the delay line only reproduces
+ * what the byte stream experiences. A sender may have at most -W bytes
+ * on the link; they are credited back one RTT after they were read,
+ * like a window-limited TCP connection would be. A lost packet delays
+ * its data (and, to keep the stream in order, everything behind it) by
+ * one more RTT, as a fast retransmission would.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "benchutil.h"
+
+#define LINKEM_EVENTS   64
+#define LINKEM_CHUNK    (16 * 1024)
+#define LINKEM_MSS      1448
+
+struct chunk {
+		struct chunk *next;
+		uint64_t release;       /* when the data leaves the link */
+		uint64_t credit;        /* when its window credit comes back */
+		size_t len;
+		size_t off;
+		int written;
+		char data[];
+};
+
+/* One direction of a relayed connection */
+struct direction {
+		int in;
+		int out;
+		int dir;                /* 0: client to target, 1: back */
+		int eof;
+		int shut;
+		int reading;
+		size_t inflight;
+		uint64_t last_release;
+		struct chunk *head;
+		struct chunk *tail;
+		struct pair *pair;
+};
+
+struct pair {
+		struct direction dirs[2];
+		int closed;
+		struct pair *next;
+};
+
+static struct {
+		uint64_t owd_ns;
+		uint64_t jitter_ns;
+		double bytes_per_ns;    /* 0 for unlimited */
+		double loss;
+		size_t window;
+		uint64_t free_at[2];    /* serialization, per direction */
+} link_cfg = {
+		.window = 4 * 1024 * 1024,
+};
+
+static struct pair *pairs = NULL;
+static int epfd;
+
+static void usage(void)
+{
+		fprintf(stderr, "Usage: %s -l ip:port -c ip:port [-r rtt ms]"
+						" [-j jitter ms] [-b Mbit/s] [-p loss %%] [-W window bytes]"
+						" [-s seed]\n", bench_name);
+		exit(EXIT_FAILURE);
+}
+
+static void set_reading(struct direction *d, int on)
+{
+		struct epoll_event ev;
+
+		if (d->reading == on) {
+				return;
+		}
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = on ? EPOLLIN : 0;
+		ev.data.ptr = d;
+		epoll_ctl(epfd, EPOLL_CTL_MOD, d->in, &ev);
+		d->reading = on;
+}
+
+static double uniform(void)
+{
+		return (double)random() / RAND_MAX;
+}
+
+/* Read what the window allows from @d->in and put it on the link */
+static int link_read(struct direction *d)
+{
+		struct chunk *c;
+		uint64_t now, start, release;
+		size_t room;
+		ssize_t rb;
+		int pkts;
+
+		room = link_cfg.window - d->inflight;
+		if (room > LINKEM_CHUNK) {
+				room = LINKEM_CHUNK;
+		}
+
+		c = malloc(sizeof(*c) + room);
+		if (!c) {
+				die("malloc");
+		}
+
+		rb = read(d->in, c->data, room);
+		if (rb <= 0) {
+				free(c);
+				if (rb < 0 && errno == EAGAIN) {
+						return 0;
+				}
+
+				d->eof = 1;
+				set_reading(d, 0);
+				return (rb < 0) ? -1 : 0;
+		}
+
+		now = now_ns();
+		start = now;
+		if (link_cfg.bytes_per_ns) {
+				if (link_cfg.free_at[d->dir] > start) {
+						start = link_cfg.free_at[d->dir];
+				}
+				link_cfg.free_at[d->dir] = start + rb / link_cfg.bytes_per_ns;
+				start = link_cfg.free_at[d->dir];
+		}
+
+		release = start + link_cfg.owd_ns;
+		if (link_cfg.jitter_ns) {
+				release += uniform() * link_cfg.jitter_ns;
+		}
+		if (link_cfg.loss > 0) {
+				pkts = (rb + LINKEM_MSS - 1) / LINKEM_MSS;
+				if (uniform() < 1 - pow(1 - link_cfg.loss, pkts)) {
+						release += 2 * link_cfg.owd_ns;
+				}
+		}
+		if (release < d->last_release) {
+				release = d->last_release;
+		}
+		d->last_release = release;
+
+		c->next = NULL;
+		c->release = release;
+		c->credit = release + link_cfg.owd_ns;
+		c->len = rb;
+		c->off = 0;
+		c->written = 0;
+		if (d->tail) {
+				d->tail->next = c;
+		}
+		else {
+				d->head = c;
+		}
+		d->tail = c;
+		d->inflight += rb;
+		if (d->inflight >= link_cfg.window) {
+				set_reading(d, 0);
+		}
+
+		return 0;
+}
+
+/*
+ * Deliver the data due on @d and return window credits.
+ * Returns the time of the next event of @d, 0 if there's none.
+ */
+static uint64_t link_flush(struct direction *d, uint64_t now)
+{
+		struct chunk *c;
+		ssize_t wb;
+
+		while ((c = d->head) && c->written && c->credit <= now) {
+				d->head = c->next;
+				if (!d->head) {
+						d->tail = NULL;
+				}
+				d->inflight -= c->len;
+				free(c);
+		}
+		if (!d->eof && d->inflight < link_cfg.window) {
+				set_reading(d, 1);
+		}
+
+		for (c = d->head; c; c = c->next) {
+				if (c->written) {
+						continue;
+				}
+				if (c->release > now) {
+						return c->release;
+				}
+
+				wb = write(d->out, c->data + c->off, c->len - c->off);
+				if (wb < 0) {
+						if (errno == EAGAIN) {
+								return now + 1000000;
+						}
+						d->pair->closed = 1;
+						return 0;
+				}
+
+				c->off += wb;
+				if (c->off < c->len) {
+						return now + 1000000;
+				}
+				c->written = 1;
+		}
+
+		if (d->eof && !d->shut && (!d->head || d->tail->written)) {
+				shutdown(d->out, SHUT_WR);
+				d->shut = 1;
+		}
+
+		return d->head ? d->head->credit : 0;
+}
+
+static void pair_free(struct pair *p)
+{
+		struct chunk *c;
+		int i;
+
+		for (i = 0; i < 2; i++) {
+				while ((c = p->dirs[i].head)) {
+						p->dirs[i].head = c->next;
+						free(c);
+				}
+		}
+		close(p->dirs[0].in);
+		close(p->dirs[1].in);
+		free(p);
+}
+
+static void link_accept(int lfd, struct sockaddr_in *target)
+{
+		struct epoll_event ev;
+		struct pair *p;
+		int cfd, tfd, i;
+
+		while ((cfd = accept(lfd, NULL, NULL)) >= 0) {
+				tfd = socket(AF_INET, SOCK_STREAM, 0);
+				if (tfd < 0 ||
+								connect(tfd, (struct sockaddr *)target, sizeof(*target)) < 0) {
+						fprintf(stderr, "%s: failed to connect to the target: %s\n",
+										bench_name, strerror(errno));
+						if (tfd >= 0) {
+								close(tfd);
+						}
+						close(cfd);
+						continue;
+				}
+
+				set_nonblock(cfd);
+				set_nonblock(tfd);
+				p = calloc(1, sizeof(*p));
+				if (!p) {
+						die("calloc");
+				}
+
+				p->dirs[0].in = p->dirs[1].out = cfd;
+				p->dirs[1].in = p->dirs[0].out = tfd;
+				for (i = 0; i < 2; i++) {
+						p->dirs[i].dir = i;
+						p->dirs[i].pair = p;
+						p->dirs[i].reading = 1;
+						memset(&ev, 0, sizeof(ev));
+						ev.events = EPOLLIN;
+						ev.data.ptr = &p->dirs[i];
+						if (epoll_ctl(epfd, EPOLL_CTL_ADD, p->dirs[i].in, &ev) < 0) {
+								die("epoll_ctl");
+						}
+				}
+				p->next = pairs;
+				pairs = p;
+		}
+}
+
+int main(int argc, char *argv[])
+{
+		struct epoll_event events[LINKEM_EVENTS], ev;
+		struct sockaddr_in laddr, target;
+		struct pair *p, **pp;
+		int have_laddr = 0, have_target = 0, c, i, n, lfd, timeout;
+		uint64_t now, next, t;
+		unsigned int seed = 1;
+
+		bench_name = argv[0];
+		signal(SIGPIPE, SIG_IGN);
+		while ((c = getopt(argc, argv, "l:c:r:j:b:p:W:s:")) != -1) {
+				switch (c) {
+						case 'l':
+								have_laddr = (parse_addr(optarg, &laddr) == 0);
+								break;
+						case 'c':
+								have_target = (parse_addr(optarg, &target) == 0);
+								break;
+						case 'r':
+								link_cfg.owd_ns = atof(optarg) * 1000000 / 2;
+								break;
+						case 'j':
+								link_cfg.jitter_ns = atof(optarg) * 1000000;
+								break;
+						case 'b':
+								link_cfg.bytes_per_ns = atof(optarg) * 1e6 / 8 / 1e9;
+								break;
+						case 'p':
+								link_cfg.loss = atof(optarg) / 100;
+								break;
+						case 'W':
+								link_cfg.window = atol(optarg);
+								break;
+						case 's':
+								seed = atoi(optarg);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!have_laddr || !have_target || link_cfg.window < LINKEM_MSS ||
+						link_cfg.loss < 0 || link_cfg.loss >= 1) {
+				usage();
+		}
+
+		srandom(seed);
+		raise_nofile();
+		lfd = listen_on(&laddr);
+		epfd = epoll_create1(0);
+		if (epfd < 0) {
+				die("epoll_create1");
+		}
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev) < 0) {
+				die("epoll_ctl");
+		}
+
+		timeout = 100;
+		for (;;) {
+				n = epoll_wait(epfd, events, LINKEM_EVENTS, timeout);
+				for (i = 0; i < n; i++) {
+						if (!events[i].data.ptr) {
+								link_accept(lfd, &target);
+								continue;
+						}
+						if (link_read(events[i].data.ptr) < 0) {
+								((struct direction *)events[i].data.ptr)->pair->closed = 1;
+						}
+				}
+
+				now = now_ns();
+				next = now + 100000000ULL;
+				for (pp = &pairs; (p = *pp);) {
+						for (i = 0; i < 2 && !p->closed; i++) {
+								t = link_flush(&p->dirs[i], now);
+								if (t && t < next) {
+										next = t;
+								}
+						}
+						if (p->closed || (p->dirs[0].shut && p->dirs[1].shut &&
+												!p->dirs[0].head && !p->dirs[1].head)) {
+								*pp = p->next;
+								pair_free(p);
+								continue;
+						}
+						pp = &p->next;
+				}
+
+				/* Round up, epoll_wait() has a millisecond resolution */
+				timeout = (next > now) ? (next - now + 999999) / 1000000 : 0;
+		}
+
+		return 0;
+}
@@ -0,0 +1,418 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+/*
+ * Microbenchmarks of the core data structures, linked against the
+ * pepsal sources: pepbuf position updates, the proxy queues under
+ * contention and the SYN table from 1k to 1M entries. Every benchmark
+ * prints one JSON line, see "make bench-micro".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "pepsal.h"
+#include "pepbuf.h"
+#include "pepqueue.h"
+#include "syntab.h"
+#include "benchutil.h"
+
+#define MICRO_QUEUE_BATCH  32
+#define MICRO_QUEUE_POOL   1024
+#define MICRO_MAX_THREADS  64
+
+static uint64_t micro_ops = 10000000;
+static int micro_threads[] = { 1, 2, 4, 8 };
+
+/* A small xorshift generator: random() would dominate the timings */
+static __inline uint32_t micro_rand(uint64_t *state)
+{
+		*state ^= *state << 13;
+		*state ^= *state >> 7;
+		*state ^= *state << 17;
+		return *state;
+}
+
+/*
+ * pepbuf: the reader fills the buffer with reads of 1 to 16 segments,
+ * the writer drains it with partial writes, like pep_proxy_data() does
+ * on a path slower than its input.
+ */
+static void micro_pepbuf(void)
+{
+		struct pep_buffer buf;
+		uint64_t i, start, elapsed, rstate = 1, rpos = 0, wpos = 0;
+		ssize_t len;
+
+		if (pepbuf_init(&buf, 0) < 0) {
+				die("pepbuf_init");
+		}
+
+		start = now_ns();
+		for (i = 0; i < micro_ops; i++) {
+				if (!pepbuf_full(&buf) && (pepbuf_empty(&buf) ||
+												(micro_rand(&rstate) & 1))) {
+						len = 1448 * (1 + micro_rand(&rstate) % 16);
+						if (len > PEPBUF_SPACE_LEFT(&buf)) {
+								len = PEPBUF_SPACE_LEFT(&buf);
+						}
+						pepbuf_update_rpos(&buf, len);
+						rpos++;
+				}
+				else {
+						len = 1 + micro_rand(&rstate) % PEPBUF_SPACE_FILLED(&buf);
+						pepbuf_update_wpos(&buf, len);
+						wpos++;
+				}
+		}
+		elapsed = now_ns() - start;
+		pepbuf_deinit(&buf);
+
+		printf("{\"bench\":\"pepbuf\",\"ops\":%" PRIu64 ",\"rpos\":%" PRIu64
+						",\"wpos\":%" PRIu64 ",\"ns_per_op\":%.2f}\n",
+						micro_ops, rpos, wpos, (double)elapsed / micro_ops);
+}
+
+struct micro_item {
+		struct pep_proxy proxy;
+		int owner;
+};
+
+struct micro_queue_ctx {
+		struct pep_queue shared;
+		struct pep_queue pools[MICRO_MAX_THREADS];
+		uint64_t per_producer;
+		uint64_t consumed;
+		int stop;
+};
+
+struct micro_thread {
+		struct micro_queue_ctx *ctx;
+		int id;
+		pthread_t thread;
+};
+
+/*
+ * Producers move batches of items from their free queue to the shared
+ * queue with pepqueue_enqueue_list(), as the poller hands proxies to the
+ * workers. Consumers dequeue them one by one, as the workers do, and
+ * give them back to their producer.
+ */
+static void *micro_producer(void *arg)
+{
+		struct micro_thread *self = arg;
+		struct micro_queue_ctx *ctx = self->ctx;
+		struct pep_queue *pool = &ctx->pools[self->id];
+		struct list_head batch, avail;
+		struct pep_proxy *proxy;
+		uint64_t produced = 0;
+		int n;
+
+		list_init_head(&avail);
+		while (produced < ctx->per_producer) {
+				if (list_is_empty(&avail)) {
+						PEPQUEUE_LOCK(pool);
+						while (!pool->num_items) {
+								PEPQUEUE_WAIT(pool);
+						}
+						pepqueue_dequeue_list(pool, &avail);
+						PEPQUEUE_UNLOCK(pool);
+						continue;
+				}
+
+				list_init_head(&batch);
+				for (n = 0; n < MICRO_QUEUE_BATCH && !list_is_empty(&avail) &&
+										produced < ctx->per_producer; n++, produced++) {
+						proxy = list_entry(list_node_first(&avail),
+										struct pep_proxy, qnode);
+						list_del(&proxy->qnode);
+						list_add2tail(&batch, &proxy->qnode);
+				}
+
+				PEPQUEUE_LOCK(&ctx->shared);
+				pepqueue_enqueue_list(&ctx->shared, &batch, n);
+				PEPQUEUE_WAKEUP_WAITERS(&ctx->shared);
+				PEPQUEUE_UNLOCK(&ctx->shared);
+		}
+
+		return NULL;
+}
+
+static void *micro_consumer(void *arg)
+{
+		struct micro_thread *self = arg;
+		struct micro_queue_ctx *ctx = self->ctx;
+		struct micro_item *item;
+		struct pep_proxy *proxy;
+		struct pep_queue *pool;
+
+		for (;;) {
+				PEPQUEUE_LOCK(&ctx->shared);
+				while (!ctx->shared.num_items && !ctx->stop) {
+						PEPQUEUE_WAIT(&ctx->shared);
+				}
+				proxy = pepqueue_dequeue(&ctx->shared);
+				PEPQUEUE_UNLOCK(&ctx->shared);
+				if (!proxy) {
+						break;
+				}
+
+				item = container_of(proxy, struct micro_item, proxy);
+				pool = &ctx->pools[item->owner];
+				PEPQUEUE_LOCK(pool);
+				pepqueue_enqueue(pool, proxy);
+				PEPQUEUE_WAKEUP_WAITERS(pool);
+				PEPQUEUE_UNLOCK(pool);
+				__atomic_add_fetch(&ctx->consumed, 1, __ATOMIC_RELAXED);
+		}
+
+		return NULL;
+}
+
+static void micro_pepqueue(int nthreads)
+{
+		struct micro_thread producers[MICRO_MAX_THREADS];
+		struct micro_thread consumers[MICRO_MAX_THREADS];
+		struct micro_queue_ctx *ctx;
+		struct micro_item *items;
+		uint64_t start, elapsed, total;
+		int i, j;
+
+		ctx = calloc(1, sizeof(*ctx));
+		items = calloc(nthreads * MICRO_QUEUE_POOL, sizeof(*items));
+		if (!ctx || !items) {
+				die("calloc");
+		}
+
+		pepqueue_init(&ctx->shared, PEPLOCK_ACTIVE_QUEUE);
+		ctx->per_producer = micro_ops / nthreads;
+		total = ctx->per_producer * nthreads;
+		for (i = 0; i < nthreads; i++) {
+				pepqueue_init(&ctx->pools[i], PEPLOCK_READY_QUEUE);
+				for (j = 0; j < MICRO_QUEUE_POOL; j++) {
+						items[i * MICRO_QUEUE_POOL + j].owner = i;
+						pepqueue_enqueue(&ctx->pools[i],
+										&items[i * MICRO_QUEUE_POOL + j].proxy);
+				}
+		}
+
+		start = now_ns();
+		for (i = 0; i < nthreads; i++) {
+				consumers[i].ctx = producers[i].ctx = ctx;
+				consumers[i].id = producers[i].id = i;
+				if (pthread_create(&consumers[i].thread, NULL,
+										micro_consumer, &consumers[i]) ||
+								pthread_create(&producers[i].thread, NULL,
+										micro_producer, &producers[i])) {
+						die("pthread_create");
+				}
+		}
+		for (i = 0; i < nthreads; i++) {
+				pthread_join(producers[i].thread, NULL);
+		}
+
+		/* The producers are done, let the consumers drain the queue */
+		PEPQUEUE_LOCK(&ctx->shared);
+		ctx->stop = 1;
+		pthread_cond_broadcast(&ctx->shared.condvar);
+		PEPQUEUE_UNLOCK(&ctx->shared);
+		for (i = 0; i < nthreads; i++) {
+				pthread_join(consumers[i].thread, NULL);
+		}
+		elapsed = now_ns() - start;
+
+		printf("{\"bench\":\"pepqueue\",\"producers\":%d,\"consumers\":%d,"
+						"\"batch\":%d,\"items\":%" PRIu64 ",\"ns_per_item\":%.2f,"
+						"\"items_per_s\":%.0f}\n", nthreads, nthreads,
+						MICRO_QUEUE_BATCH, ctx->consumed, (double)elapsed / total,
+						total * 1e9 / elapsed);
+		if (ctx->consumed != total) {
+				fprintf(stderr, "%s: pepqueue lost %" PRIu64 " items\n",
+								bench_name, total - ctx->consumed);
+				exit(EXIT_FAILURE);
+		}
+
+		free(items);
+		free(ctx);
+}
+
+/*
+ * Client endpoints of a satellite network: a few connections from
+ * each of many hosts spread over 10.0.0.0/8, ephemeral source ports.
+ * Entry @i gets a unique address:port pair.
+ */
+static void micro_endpoint(uint32_t i, uint64_t *rstate,
+				struct pep_endpoint *endp)
+{
+		uint32_t host = i / 8;
+
+		endp->addr = htonl(0x0a000000 | ((host * 2654435761u) & 0xffffff));
+		endp->port = 32768 + (i % 8) * 3500 + micro_rand(rstate) % 3500;
+}
+
+static void micro_shuffle(struct pep_proxy **order, uint32_t n,
+				uint64_t *rstate)
+{
+		struct pep_proxy *tmp;
+		uint32_t i, j;
+
+		for (i = n - 1; i > 0; i--) {
+				j = micro_rand(rstate) % (i + 1);
+				tmp = order[i];
+				order[i] = order[j];
+				order[j] = tmp;
+		}
+}
+
+static void micro_syntab(uint32_t n)
+{
+		struct pep_proxy *proxies, **order;
+		struct syntab_stats stats;
+		struct syntab_key key;
+		uint64_t start, t_add, t_hit, t_miss, t_del, rstate = n;
+		uint32_t i, found = 0;
+
+		proxies = calloc(n, sizeof(*proxies));
+		order = calloc(n, sizeof(*order));
+		if (!proxies || !order) {
+				die("calloc");
+		}
+		if (syntab_init(n) < 0) {
+				die("syntab_init");
+		}
+
+		for (i = 0; i < n; i++) {
+				proxies[i].status = PST_PENDING;
+				micro_endpoint(i, &rstate, &proxies[i].src);
+				order[i] = &proxies[i];
+		}
+		micro_shuffle(order, n, &rstate);
+
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+				if (syntab_add(order[i]) < 0) {
+						die("syntab_add");
+				}
+		}
+		t_add = now_ns() - start;
+		syntab_get_stats(&stats);
+
+		micro_shuffle(order, n, &rstate);
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+				syntab_format_key(order[i], &key);
+				found += (syntab_find(&key) == order[i]);
+		}
+		t_hit = now_ns() - start;
+
+		/* Same hosts, ports no client uses */
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+				syntab_format_key(order[i], &key);
+				key.port = 1 + i % 1024;
+				found += (syntab_find(&key) != NULL);
+		}
+		t_miss = now_ns() - start;
+
+		micro_shuffle(order, n, &rstate);
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+				syntab_delete(order[i]);
+		}
+		t_del = now_ns() - start;
+
+		printf("{\"bench\":\"syntab\",\"entries\":%u,\"buckets\":%u,"
+						"\"longest_chain\":%u,\"load_factor\":%.2f,"
+						"\"add_ns\":%.1f,\"find_hit_ns\":%.1f,\"find_miss_ns\":%.1f,"
+						"\"delete_ns\":%.1f}\n", n, stats.buckets,
+						stats.longest_chain, stats.load_factor, (double)t_add / n,
+						(double)t_hit / n, (double)t_miss / n, (double)t_del / n);
+		if (found != n) {
+				fprintf(stderr, "%s: syntab found %u of %u entries\n",
+								bench_name, found, n);
+				exit(EXIT_FAILURE);
+		}
+
+		hashtable_destroy(syntab.hash, 0);
+		pthread_rwlock_destroy(&syntab.lock);
+		free(order);
+		free(proxies);
+}
+
+/* Run everything when no benchmark is named on the command line */
+static int micro_selected(int argc, char *argv[], const char *name)
+{
+		int i;
+
+		for (i = optind; i < argc; i++) {
+				if (!strcmp(argv[i], name)) {
+						return 1;
+				}
+		}
+
+		return (optind == argc);
+}
+
+static void usage(void)
+{
+		fprintf(stderr, "Usage: %s [-n ops] [-m max syntab entries]"
+						" [pepbuf] [pepqueue] [syntab]\n", bench_name);
+		exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+		uint32_t n, max_entries = 1000000;
+		int c, i;
+
+		bench_name = argv[0];
+		while ((c = getopt(argc, argv, "n:m:h")) != -1) {
+				switch (c) {
+						case 'n':
+								micro_ops = strtoull(optarg, NULL, 10);
+								break;
+						case 'm':
+								max_entries = strtoul(optarg, NULL, 10);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!micro_ops || !max_entries) {
+				usage();
+		}
+
+		for (i = optind; i < argc; i++) {
+				if (strcmp(argv[i], "pepbuf") && strcmp(argv[i], "pepqueue") &&
+								strcmp(argv[i], "syntab")) {
+						usage();
+				}
+		}
+
+		if (micro_selected(argc, argv, "pepbuf")) {
+				micro_pepbuf();
+		}
+		if (micro_selected(argc, argv, "pepqueue")) {
+				for (i = 0; i < sizeof(micro_threads) / sizeof(*micro_threads); i++) {
+						micro_pepqueue(micro_threads[i]);
+				}
+		}
+		if (micro_selected(argc, argv, "syntab")) {
+				for (n = 1000; n <= max_entries; n *= 10) {
+						micro_syntab(n);
+				}
+		}
+
+		return 0;
+}
@@ -0,0 +1,1021 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+/*
+ * pepbench: traffic generators for loopback benchmarks of pepsal
+ * running with a static destination (-D).
+ *
+ * source/sink: the source opens a number of flows to pepsal and writes
+ * into them as fast as they accept data, the sink accepts the relayed
+ * flows, discards what it reads and reports, after a warmup, the
+ * aggregate throughput, the fairness between flows and the CPU time
+ * pepsal used per GB.
+ *
+ * churn/server: the churn client opens short connections at a given
+ * rate, sends a request and reads the server's response until the
+ * server closes, and reports the sustained connection rate, setup
+ * latency percentiles and the growth of pepsal's resident memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "benchutil.h"
+
+#define BENCH_EVENTS   256
+#define BENCH_BUF_SZ   (256 * 1024)
+
+struct flow {
+		int fd;
+		int slow;           /* read at the slow rate, not measured */
+		uint64_t bytes;
+		uint64_t base;      /* bytes at the start of the measurement */
+		uint64_t last_read;
+		uint64_t max_gap;   /* longest time without data while measuring */
+};
+
+/* A short request/response connection of the churn client or server */
+enum conn_state {
+		CONN_FREE = 0,
+		CONN_CONNECTING,
+		CONN_WAITING,       /* client: request sent; server: reading it */
+		CONN_RESPONDING,    /* server: writing the response */
+};
+
+struct conn {
+		enum conn_state state;
+		size_t done;
+		uint64_t start;
+		uint64_t connected;
+		uint64_t first_byte;
+};
+
+static char buf[BENCH_BUF_SZ];
+
+static void usage(void)
+{
+		fprintf(stderr, "Usage: %s source -c ip:port [-n flows] [-b write size]"
+						" [-t seconds]\n"
+						"       %s sink -l ip:port [-n flows] [-w warmup seconds]"
+						" [-t seconds] [-P pepsal pid] [-s slow flows]"
+						" [-R slow bytes/s]\n"
+						"       %s churn -c ip:port [-r conns/s] [-m max concurrent]"
+						" [-q request size] [-w warmup seconds] [-t seconds]"
+						" [-P pepsal pid]\n"
+						"       %s server -l ip:port [-q request size]"
+						" [-s response size]\n"
+						"       %s soak -c ip:port [-n conns] [-r conns/s]"
+						" [-k keepalive seconds] [-t seconds] [-i report seconds]"
+						" [-P pepsal pid]\n"
+						"       %s echo -l ip:port\n", bench_name, bench_name,
+						bench_name, bench_name, bench_name, bench_name);
+		exit(EXIT_FAILURE);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+		double da = *(const double *)a, db = *(const double *)b;
+
+		return (da > db) - (da < db);
+}
+
+static int source(int argc, char *argv[])
+{
+		struct epoll_event events[BENCH_EVENTS];
+		struct sockaddr_in addr;
+		int have_addr = 0, nflows = 1, wsize = 64 * 1024, seconds = 10;
+		int c, i, fd, epfd, n, failed = 0;
+		uint64_t deadline;
+		ssize_t wb;
+
+		while ((c = getopt(argc, argv, "c:n:b:t:")) != -1) {
+				switch (c) {
+						case 'c':
+								have_addr = (parse_addr(optarg, &addr) == 0);
+								break;
+						case 'n':
+								nflows = atoi(optarg);
+								break;
+						case 'b':
+								wsize = atoi(optarg);
+								break;
+						case 't':
+								seconds = atoi(optarg);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!have_addr || nflows <= 0 || wsize <= 0 || wsize > BENCH_BUF_SZ) {
+				usage();
+		}
+
+		raise_nofile();
+		epfd = epoll_create1(0);
+		if (epfd < 0) {
+				die("epoll_create1");
+		}
+
+		for (i = 0; i < nflows; i++) {
+				fd = socket(AF_INET, SOCK_STREAM, 0);
+				if (fd < 0) {
+						die("socket");
+				}
+
+				set_nonblock(fd);
+				if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+								errno != EINPROGRESS) {
+						die("connect");
+				}
+				epoll_add(epfd, fd, EPOLLOUT | EPOLLET);
+		}
+
+		deadline = now_ns() + (uint64_t)seconds * 1000000000ULL;
+		while (now_ns() < deadline) {
+				n = epoll_wait(epfd, events, BENCH_EVENTS, 100);
+				for (i = 0; i < n; i++) {
+						fd = events[i].data.fd;
+						if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+								failed++;
+								epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+								close(fd);
+								continue;
+						}
+
+						do {
+								wb = write(fd, buf, wsize);
+						} while (wb > 0);
+						if (wb < 0 && errno != EAGAIN) {
+								failed++;
+								epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+								close(fd);
+						}
+				}
+		}
+
+		if (failed) {
+				fprintf(stderr, "pepbench: %d of %d flows failed\n", failed, nflows);
+		}
+		return 0;
+}
+
+static void sink_report(struct flow *flows, int maxfd, int nflows,
+				double seconds, double cpu, uint64_t end)
+{
+		double *rates, *gaps, sum = 0, sumsq = 0, mbps;
+		uint64_t bytes = 0, slow_bytes = 0, delta;
+		int i, n = 0, nslow = 0;
+
+		rates = calloc(maxfd + 1, sizeof(*rates));
+		gaps = calloc(maxfd + 1, sizeof(*gaps));
+		if (!rates || !gaps) {
+				die("calloc");
+		}
+
+		for (i = 0; i <= maxfd; i++) {
+				if (!flows[i].fd) {
+						continue;
+				}
+
+				delta = flows[i].bytes - flows[i].base;
+				if (flows[i].slow) {
+						slow_bytes += delta;
+						nslow++;
+						continue;
+				}
+				if (end - flows[i].last_read > flows[i].max_gap) {
+						flows[i].max_gap = end - flows[i].last_read;
+				}
+
+				bytes += delta;
+				rates[n] = delta * 8 / seconds / 1e6;
+				gaps[n] = flows[i].max_gap / 1e6;
+				sum += rates[n];
+				sumsq += rates[n] * rates[n];
+				n++;
+		}
+		qsort(rates, n, sizeof(*rates), cmp_double);
+		qsort(gaps, n, sizeof(*gaps), cmp_double);
+
+		mbps = bytes * 8 / seconds / 1e6;
+		printf("{\"flows\":%d,\"measured_flows\":%d,\"seconds\":%.2f,"
+						"\"bytes\":%" PRIu64 ",\"mbps\":%.1f,\"jain\":%.4f",
+						nflows, n, seconds, bytes, mbps,
+						sumsq ? sum * sum / (n * sumsq) : 0.0);
+		if (n) {
+				printf(",\"flow_mbps\":{\"min\":%.2f,\"p10\":%.2f,\"p50\":%.2f,"
+								"\"p90\":%.2f,\"max\":%.2f}", rates[0], rates[n / 10],
+								rates[n / 2], rates[n * 9 / 10], rates[n - 1]);
+				/* The longest stall of every measured flow */
+				printf(",\"gap_ms\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+								"\"max\":%.1f}", gaps[n / 2], gaps[n * 9 / 10],
+								gaps[n * 99 / 100], gaps[n - 1]);
+		}
+		if (nslow) {
+				printf(",\"slow_flows\":%d,\"slow_mbps\":%.3f", nslow,
+								slow_bytes * 8 / seconds / 1e6);
+		}
+		if (cpu >= 0) {
+				printf(",\"proxy_cpu_s\":%.2f,\"proxy_cpu_s_per_gb\":%.3f", cpu,
+								bytes ? cpu / (bytes / 1e9) : 0.0);
+		}
+		printf("}\n");
+		fflush(stdout);
+		free(gaps);
+		free(rates);
+}
+
+static int sink(int argc, char *argv[])
+{
+		struct epoll_event events[BENCH_EVENTS];
+		struct sockaddr_in addr;
+		struct flow *flows;
+		int have_addr = 0, nflows = 1, warmup = 2, seconds = 10;
+		int nslow = 0, slow_rate = 0, c, i, fd, lfd, epfd, n, maxfd;
+		int measuring = 0;
+		uint64_t start = 0, now = 0, window_start = 0, window_end = 0;
+		uint64_t next_slow = 0;
+		double cpu_start = -1, cpu_end;
+		size_t quota;
+		pid_t pid = 0;
+		ssize_t rb;
+
+		while ((c = getopt(argc, argv, "l:n:w:t:P:s:R:")) != -1) {
+				switch (c) {
+						case 'l':
+								have_addr = (parse_addr(optarg, &addr) == 0);
+								break;
+						case 'n':
+								nflows = atoi(optarg);
+								break;
+						case 'w':
+								warmup = atoi(optarg);
+								break;
+						case 't':
+								seconds = atoi(optarg);
+								break;
+						case 'P':
+								pid = atoi(optarg);
+								break;
+						case 's':
+								nslow = atoi(optarg);
+								break;
+						case 'R':
+								slow_rate = atoi(optarg);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!have_addr || seconds <= 0 || nslow < 0 || slow_rate < 0) {
+				usage();
+		}
+		quota = (slow_rate + 9) / 10;
+		if (quota > sizeof(buf)) {
+				quota = sizeof(buf);
+		}
+
+		maxfd = raise_nofile();
+		flows = calloc(maxfd, sizeof(*flows));
+		if (!flows) {
+				die("calloc");
+		}
+
+		lfd = listen_on(&addr);
+		epfd = epoll_create1(0);
+		if (epfd < 0) {
+				die("epoll_create1");
+		}
+		epoll_add(epfd, lfd, EPOLLIN);
+
+		maxfd = 0;
+		for (;;) {
+				n = epoll_wait(epfd, events, BENCH_EVENTS, 100);
+				now = now_ns();
+				for (i = 0; i < n; i++) {
+						fd = events[i].data.fd;
+						if (fd == lfd) {
+								while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+										set_nonblock(fd);
+										memset(&flows[fd], 0, sizeof(flows[fd]));
+										flows[fd].fd = fd;
+										/* The first flows are the slow ones, read on a timer */
+										if (nslow) {
+												flows[fd].slow = 1;
+												nslow--;
+										}
+										else {
+												epoll_add(epfd, fd, EPOLLIN);
+										}
+										if (fd > maxfd) {
+												maxfd = fd;
+										}
+										if (!start) {
+												start = now;
+												window_start = start + warmup * 1000000000ULL;
+												window_end = window_start + seconds * 1000000000ULL;
+										}
+								}
+								continue;
+						}
+
+						/* One read per event, draining a busy flow would starve the others */
+						rb = read(fd, buf, sizeof(buf));
+						if (rb > 0) {
+								flows[fd].bytes += rb;
+								if (measuring && now - flows[fd].last_read > flows[fd].max_gap) {
+										flows[fd].max_gap = now - flows[fd].last_read;
+								}
+								flows[fd].last_read = now;
+						}
+						else if (rb == 0 || errno != EAGAIN) {
+								epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+								close(fd);
+						}
+				}
+
+				if (!start) {
+						continue;
+				}
+
+				/* Slow consumers get a tenth of their rate every 100ms */
+				if (quota && now >= next_slow) {
+						for (i = 0; i <= maxfd; i++) {
+								if (!flows[i].fd || !flows[i].slow) {
+										continue;
+								}
+								rb = read(i, buf, quota);
+								if (rb > 0) {
+										flows[i].bytes += rb;
+								}
+						}
+						next_slow = now + 100000000ULL;
+				}
+
+				if (!measuring && now >= window_start) {
+						for (i = 0; i <= maxfd; i++) {
+								flows[i].base = flows[i].bytes;
+								flows[i].last_read = now;
+						}
+						cpu_start = proc_cpu(pid);
+						measuring = 1;
+				}
+				if (now >= window_end) {
+						break;
+				}
+		}
+
+		cpu_end = proc_cpu(pid);
+		sink_report(flows, maxfd, nflows, (now - window_start) / 1e9,
+						(cpu_start >= 0 && cpu_end >= 0) ? cpu_end - cpu_start : -1, now);
+		return 0;
+}
+
+static int server(int argc, char *argv[])
+{
+		struct epoll_event events[BENCH_EVENTS];
+		struct sockaddr_in addr;
+		struct conn *conns;
+		size_t reqsize = 512, respsize = 16 * 1024;
+		int have_addr = 0, c, i, fd, lfd, epfd, n;
+		ssize_t ret;
+
+		while ((c = getopt(argc, argv, "l:q:s:")) != -1) {
+				switch (c) {
+						case 'l':
+								have_addr = (parse_addr(optarg, &addr) == 0);
+								break;
+						case 'q':
+								reqsize = atoi(optarg);
+								break;
+						case 's':
+								respsize = atoi(optarg);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!have_addr || !reqsize || respsize > BENCH_BUF_SZ) {
+				usage();
+		}
+
+		conns = calloc(raise_nofile(), sizeof(*conns));
+		if (!conns) {
+				die("calloc");
+		}
+
+		lfd = listen_on(&addr);
+		epfd = epoll_create1(0);
+		if (epfd < 0) {
+				die("epoll_create1");
+		}
+		epoll_add(epfd, lfd, EPOLLIN);
+
+		for (;;) {
+				n = epoll_wait(epfd, events, BENCH_EVENTS, -1);
+				for (i = 0; i < n; i++) {
+						fd = events[i].data.fd;
+						if (fd == lfd) {
+								while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+										set_nonblock(fd);
+										epoll_add(epfd, fd, EPOLLIN);
+										conns[fd].state = CONN_WAITING;
+										conns[fd].done = 0;
+								}
+								continue;
+						}
+
+						if (conns[fd].state == CONN_WAITING) {
+								ret = read(fd, buf, sizeof(buf));
+								if (ret <= 0) {
+										if (ret < 0 && errno == EAGAIN) {
+												continue;
+										}
+										goto close_conn;
+								}
+
+								conns[fd].done += ret;
+								if (conns[fd].done < reqsize) {
+										continue;
+								}
+
+								conns[fd].state = CONN_RESPONDING;
+								conns[fd].done = 0;
+						}
+
+						ret = write(fd, buf + conns[fd].done, respsize - conns[fd].done);
+						if (ret < 0 && errno != EAGAIN) {
+								goto close_conn;
+						}
+						if (ret > 0) {
+								conns[fd].done += ret;
+						}
+						if (conns[fd].done < respsize) {
+								struct epoll_event ev = { .events = EPOLLOUT, .data.fd = fd };
+
+								epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+								continue;
+						}
+
+close_conn:
+						/* The client reads the response until it sees EOF */
+						epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+						close(fd);
+						conns[fd].state = CONN_FREE;
+				}
+		}
+
+		return 0;
+}
+
+/* Start a new churn connection, returns its descriptor or -1 */
+static int churn_open(int epfd, struct sockaddr_in *addr, struct conn *conns,
+				int maxfd)
+{
+		int fd;
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) {
+				return -1;
+		}
+		if (fd >= maxfd) {
+				close(fd);
+				errno = EMFILE;
+				return -1;
+		}
+
+		set_nonblock(fd);
+		memset(&conns[fd], 0, sizeof(conns[fd]));
+		conns[fd].state = CONN_CONNECTING;
+		conns[fd].start = now_ns();
+		if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0 &&
+						errno != EINPROGRESS) {
+				close(fd);
+				conns[fd].state = CONN_FREE;
+				return -1;
+		}
+		epoll_add(epfd, fd, EPOLLOUT);
+
+		return fd;
+}
+
+static int churn(int argc, char *argv[])
+{
+		struct epoll_event events[BENCH_EVENTS], ev;
+		struct sockaddr_in addr;
+		struct samples connect_lat = { 0 }, ttfb = { 0 }, total = { 0 };
+		struct conn *conn, *conns;
+		size_t reqsize = 512;
+		int have_addr = 0, rate = 1000, maxconc = 1000, warmup = 2, seconds = 10;
+		int c, i, fd, epfd, n, maxfd, active = 0, err, measuring = 0;
+		uint64_t start, now, window_start, window_end, started = 0;
+		uint64_t completed = 0, failed = 0, throttled = 0, due;
+		long rss_start = -1, rss_end;
+		socklen_t errlen;
+		pid_t pid = 0;
+		ssize_t ret;
+
+		while ((c = getopt(argc, argv, "c:r:m:q:w:t:P:")) != -1) {
+				switch (c) {
+						case 'c':
+								have_addr = (parse_addr(optarg, &addr) == 0);
+								break;
+						case 'r':
+								rate = atoi(optarg);
+								break;
+						case 'm':
+								maxconc = atoi(optarg);
+								break;
+						case 'q':
+								reqsize = atoi(optarg);
+								break;
+						case 'w':
+								warmup = atoi(optarg);
+								break;
+						case 't':
+								seconds = atoi(optarg);
+								break;
+						case 'P':
+								pid = atoi(optarg);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!have_addr || rate <= 0 || maxconc <= 0 || !reqsize ||
+						reqsize > BENCH_BUF_SZ || seconds <= 0) {
+				usage();
+		}
+
+		maxfd = raise_nofile();
+		conns = calloc(maxfd, sizeof(*conns));
+		if (!conns) {
+				die("calloc");
+		}
+
+		epfd = epoll_create1(0);
+		if (epfd < 0) {
+				die("epoll_create1");
+		}
+
+		start = now_ns();
+		window_start = start + warmup * 1000000000ULL;
+		window_end = window_start + seconds * 1000000000ULL;
+		for (;;) {
+				now = now_ns();
+				if (now >= window_end) {
+						break;
+				}
+				if (!measuring && now >= window_start) {
+						rss_start = proc_rss(pid);
+						completed = failed = throttled = 0;
+						connect_lat.n = ttfb.n = total.n = 0;
+						measuring = 1;
+				}
+
+				/* Open loop: keep up with the rate unless too many are pending */
+				due = (now - start) * rate / 1000000000ULL;
+				while (started < due) {
+						started++;
+						if (active >= maxconc) {
+								throttled++;
+								continue;
+						}
+						if (churn_open(epfd, &addr, conns, maxfd) < 0) {
+								failed++;
+								continue;
+						}
+						active++;
+				}
+
+				n = epoll_wait(epfd, events, BENCH_EVENTS, 1);
+				for (i = 0; i < n; i++) {
+						fd = events[i].data.fd;
+						conn = &conns[fd];
+						if (conn->state == CONN_CONNECTING) {
+								errlen = sizeof(err);
+								getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+								if (err) {
+										failed++;
+										goto close_conn;
+								}
+
+								conn->connected = now_ns();
+								if (write(fd, buf, reqsize) != (ssize_t)reqsize) {
+										failed++;
+										goto close_conn;
+								}
+
+								conn->state = CONN_WAITING;
+								ev.events = EPOLLIN;
+								ev.data.fd = fd;
+								epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+								continue;
+						}
+
+						while ((ret = read(fd, buf, sizeof(buf))) > 0) {
+								if (!conn->first_byte) {
+										conn->first_byte = now_ns();
+								}
+								conn->done += ret;
+						}
+						if (ret < 0 && errno == EAGAIN) {
+								continue;
+						}
+						if (ret < 0 || !conn->done) {
+								failed++;
+								goto close_conn;
+						}
+
+						completed++;
+						samples_add(&connect_lat, conn->connected - conn->start);
+						samples_add(&ttfb, conn->first_byte - conn->start);
+						samples_add(&total, now_ns() - conn->start);
+
+close_conn:
+						epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+						close(fd);
+						conn->state = CONN_FREE;
+						active--;
+				}
+		}
+
+		rss_end = proc_rss(pid);
+		printf("{\"rate\":%d,\"seconds\":%d,\"completed\":%" PRIu64
+						",\"conns_per_s\":%.1f,\"failed\":%" PRIu64
+						",\"throttled\":%" PRIu64 ",\"connect_us\":", rate, seconds,
+						completed, (double)completed / seconds, failed, throttled);
+		samples_print_json(&connect_lat);
+		printf(",\"ttfb_us\":");
+		samples_print_json(&ttfb);
+		printf(",\"total_us\":");
+		samples_print_json(&total);
+		if (rss_start >= 0 && rss_end >= 0) {
+				printf(",\"proxy_rss_kb\":{\"start\":%ld,\"end\":%ld,\"growth\":%ld}",
+								rss_start, rss_end, rss_end - rss_start);
+		}
+		printf("}\n");
+		fflush(stdout);
+
+		return 0;
+}
+
+/* Echo back whatever the soak client sends */
+static int echo(int argc, char *argv[])
+{
+		struct epoll_event events[BENCH_EVENTS];
+		struct sockaddr_in addr;
+		int have_addr = 0, c, i, fd, lfd, epfd, n;
+		ssize_t ret;
+
+		while ((c = getopt(argc, argv, "l:")) != -1) {
+				switch (c) {
+						case 'l':
+								have_addr = (parse_addr(optarg, &addr) == 0);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!have_addr) {
+				usage();
+		}
+
+		raise_nofile();
+		lfd = listen_on(&addr);
+		epfd = epoll_create1(0);
+		if (epfd < 0) {
+				die("epoll_create1");
+		}
+		epoll_add(epfd, lfd, EPOLLIN);
+
+		for (;;) {
+				n = epoll_wait(epfd, events, BENCH_EVENTS, -1);
+				for (i = 0; i < n; i++) {
+						fd = events[i].data.fd;
+						if (fd == lfd) {
+								while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+										set_nonblock(fd);
+										epoll_add(epfd, fd, EPOLLIN);
+								}
+								continue;
+						}
+
+						/* Keepalives are tiny, a full send buffer just drops them */
+						ret = read(fd, buf, sizeof(buf));
+						if (ret > 0) {
+								if (write(fd, buf, ret) < 0 && errno != EAGAIN) {
+										ret = -1;
+								}
+						}
+						if (ret == 0 || (ret < 0 && errno != EAGAIN)) {
+								epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+								close(fd);
+						}
+				}
+		}
+
+		return 0;
+}
+
+/* A long-lived, mostly idle connection of the soak client */
+struct soak_conn {
+		enum conn_state state;
+		uint32_t gen;           /* tells reused descriptors apart */
+		uint64_t sent;          /* when the pending keepalive was sent */
+};
+
+/* Keepalives are due in the order the connections were established */
+struct soak_timer {
+		int fd;
+		uint32_t gen;
+		uint64_t due;
+};
+
+struct soak_totals {
+		uint64_t established;
+		uint64_t failed;
+		uint64_t closed;
+		uint64_t keepalives;
+		uint64_t missed;
+};
+
+static void soak_report(double t, int ramping, struct soak_totals *tot,
+				struct samples *echo_lat, pid_t pid, long rss_base, long tcp_base,
+				double *cpu, double *poller_cpu, double interval)
+{
+		long rss = proc_rss(pid), tcp = sockstat_tcp_mem();
+		double now_cpu = proc_cpu(pid);
+		double now_poller = proc_thread_cpu(pid, "pep-poller");
+		uint64_t conns = tot->established - tot->closed;
+
+		printf("{\"t\":%.0f,\"phase\":\"%s\",\"conns\":%" PRIu64
+						",\"failed\":%" PRIu64 ",\"closed\":%" PRIu64
+						",\"keepalives\":%" PRIu64 ",\"missed\":%" PRIu64 ",\"echo_us\":",
+						t, ramping ? "ramp" : "hold", conns, tot->failed, tot->closed,
+						tot->keepalives, tot->missed);
+		samples_print_json(echo_lat);
+		echo_lat->n = 0;
+		if (rss >= 0) {
+				printf(",\"proxy_rss_kb\":%ld,\"proxy_rss_per_conn_b\":%.0f", rss,
+								conns ? (rss - rss_base) * 1024.0 / conns : 0.0);
+		}
+		if (tcp >= 0) {
+				printf(",\"tcp_mem_kb\":%ld,\"tcp_mem_per_conn_b\":%.0f", tcp,
+								conns ? (tcp - tcp_base) * 1024.0 / conns : 0.0);
+		}
+		if (now_cpu >= 0) {
+				printf(",\"proxy_cpu_pct\":%.1f", (now_cpu - *cpu) * 100 / interval);
+				*cpu = now_cpu;
+		}
+		if (now_poller >= 0) {
+				printf(",\"poller_cpu_pct\":%.1f",
+								(now_poller - *poller_cpu) * 100 / interval);
+				*poller_cpu = now_poller;
+		}
+		printf("}\n");
+		fflush(stdout);
+}
+
+/*
+ * Open @nconns connections at @rate per second and hold them for
+ * @seconds, each sending a one byte keepalive every @keepalive seconds
+ * and timing its echo. Prints one JSON line every @interval seconds.
+ */
+static int soak(int argc, char *argv[])
+{
+		struct epoll_event events[BENCH_EVENTS], ev;
+		struct sockaddr_in addr;
+		struct samples echo_lat = { 0 };
+		struct soak_totals tot = { 0 };
+		struct soak_timer *timers;
+		struct soak_conn *conns, *conn;
+		int have_addr = 0, nconns = 10000, rate = 1000, keepalive = 30;
+		int seconds = 3600, interval = 60, c, i, fd, epfd, n, maxfd, err;
+		int ramping = 1, opened = 0, thead = 0, ttail = 0;
+		uint64_t start, now, hold_end = 0, next_report, due;
+		uint32_t gen;
+		long rss_base, tcp_base;
+		double cpu, poller_cpu, last_report;
+		socklen_t errlen;
+		pid_t pid = 0;
+		ssize_t ret;
+
+		while ((c = getopt(argc, argv, "c:n:r:k:t:i:P:")) != -1) {
+				switch (c) {
+						case 'c':
+								have_addr = (parse_addr(optarg, &addr) == 0);
+								break;
+						case 'n':
+								nconns = atoi(optarg);
+								break;
+						case 'r':
+								rate = atoi(optarg);
+								break;
+						case 'k':
+								keepalive = atoi(optarg);
+								break;
+						case 't':
+								seconds = atoi(optarg);
+								break;
+						case 'i':
+								interval = atoi(optarg);
+								break;
+						case 'P':
+								pid = atoi(optarg);
+								break;
+						default:
+								usage();
+				}
+		}
+		if (!have_addr || nconns <= 0 || rate <= 0 || keepalive <= 0 ||
+						seconds <= 0 || interval <= 0) {
+				usage();
+		}
+
+		maxfd = raise_nofile();
+		conns = calloc(maxfd, sizeof(*conns));
+		timers = calloc(nconns + 1, sizeof(*timers));
+		if (!conns || !timers) {
+				die("calloc");
+		}
+
+		epfd = epoll_create1(0);
+		if (epfd < 0) {
+				die("epoll_create1");
+		}
+
+		rss_base = proc_rss(pid);
+		tcp_base = sockstat_tcp_mem();
+		cpu = proc_cpu(pid);
+		poller_cpu = proc_thread_cpu(pid, "pep-poller");
+		start = now_ns();
+		next_report = start + interval * 1000000000ULL;
+		last_report = 0;
+		for (;;) {
+				now = now_ns();
+				if (now >= next_report) {
+						soak_report((now - start) / 1e9, ramping, &tot, &echo_lat,
+										pid, rss_base, tcp_base, &cpu, &poller_cpu,
+										(now - start) / 1e9 - last_report);
+						last_report = (now - start) / 1e9;
+						next_report += interval * 1000000000ULL;
+				}
+				if (hold_end && now >= hold_end) {
+						break;
+				}
+
+				/* Ramp up at the given rate, connections aren't reopened */
+				due = (now - start) * rate / 1000000000ULL;
+				while (ramping && opened < nconns && opened < due) {
+						opened++;
+						fd = socket(AF_INET, SOCK_STREAM, 0);
+						if (fd < 0 || fd >= maxfd) {
+								if (fd >= 0) {
+										close(fd);
+								}
+								tot.failed++;
+								continue;
+						}
+
+						set_nonblock(fd);
+						if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+										errno != EINPROGRESS) {
+								close(fd);
+								tot.failed++;
+								continue;
+						}
+						conns[fd].state = CONN_CONNECTING;
+						conns[fd].gen++;
+						conns[fd].sent = 0;
+						epoll_add(epfd, fd, EPOLLOUT);
+				}
+
+				/* Keepalives of the connections that are due */
+				while (thead != ttail && timers[thead].due <= now) {
+						fd = timers[thead].fd;
+						conn = &conns[fd];
+						gen = timers[thead].gen;
+						thead = (thead + 1) % (nconns + 1);
+						if (conn->state != CONN_WAITING || conn->gen != gen) {
+								continue;
+						}
+
+						if (conn->sent) {
+								tot.missed++;
+						}
+						else if (write(fd, buf, 1) == 1) {
+								conn->sent = now;
+								tot.keepalives++;
+						}
+						timers[ttail].fd = fd;
+						timers[ttail].gen = gen;
+						timers[ttail].due = now + keepalive * 1000000000ULL;
+						ttail = (ttail + 1) % (nconns + 1);
+				}
+
+				n = epoll_wait(epfd, events, BENCH_EVENTS, 1);
+				for (i = 0; i < n; i++) {
+						fd = events[i].data.fd;
+						conn = &conns[fd];
+						if (conn->state == CONN_CONNECTING) {
+								errlen = sizeof(err);
+								getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+								if (err) {
+										tot.failed++;
+										goto close_conn;
+								}
+
+								tot.established++;
+								conn->state = CONN_WAITING;
+								ev.events = EPOLLIN;
+								ev.data.fd = fd;
+								epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+								timers[ttail].fd = fd;
+								timers[ttail].gen = conn->gen;
+								timers[ttail].due = now_ns() + keepalive * 1000000000ULL;
+								ttail = (ttail + 1) % (nconns + 1);
+								continue;
+						}
+
+						ret = read(fd, buf, sizeof(buf));
+						if (ret > 0) {
+								if (conn->sent) {
+										samples_add(&echo_lat, now_ns() - conn->sent);
+										conn->sent = 0;
+								}
+								continue;
+						}
+						if (ret < 0 && errno == EAGAIN) {
+								continue;
+						}
+						tot.closed++;
+
+close_conn:
+						epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+						close(fd);
+						conn->state = CONN_FREE;
+				}
+
+				if (ramping && opened == nconns &&
+								tot.established + tot.failed >= (uint64_t)nconns) {
+						ramping = 0;
+						hold_end = now_ns() + seconds * 1000000000ULL;
+				}
+		}
+
+		soak_report((now_ns() - start) / 1e9, ramping, &tot, &echo_lat, pid,
+						rss_base, tcp_base, &cpu, &poller_cpu,
+						(now_ns() - start) / 1e9 - last_report);
+
+		return 0;
+}
+
+int main(int argc, char *argv[])
+{
+		signal(SIGPIPE, SIG_IGN);
+		bench_name = argv[0];
+		if (argc < 2) {
+				usage();
+		}
+
+		if (!strcmp(argv[1], "source")) {
+				return source(argc - 1, argv + 1);
+		}
+		if (!strcmp(argv[1], "sink")) {
+				return sink(argc - 1, argv + 1);
+		}
+		if (!strcmp(argv[1], "churn")) {
+				return churn(argc - 1, argv + 1);
+		}
+		if (!strcmp(argv[1], "server")) {
+				return server(argc - 1, argv + 1);
+		}
+		if (!strcmp(argv[1], "soak")) {
+				return soak(argc - 1, argv + 1);
+		}
+		if (!strcmp(argv[1], "echo")) {
+				return echo(argc - 1, argv + 1);
+		}
+
+		usage();
+		return EXIT_FAILURE;
+}
@@ -0,0 +1,127 @@
+#!/bin/bash
+#
+# Performance regression gate, see "make bench-regress".
+#
+# Runs a fixed set of benchmarks (throughput, churn, a short soak and
+# the microbenchmarks), stores the results in a versioned JSON file and
+# compares them against a baseline file produced the same way. Exits
+# with 1 if a metric is worse than the baseline by more than the
+# tolerance. Without a baseline, only the results are stored.
+#
+# The result file has one result object per line:
+#
+#   {"version":1,"commit":"...","date":"...","results":[
+#   {"test":"throughput","flows":1,...},
+#   ...
+#   ]}
+#
+# Usage: regress.sh PEPSAL PEPBENCH MICRO
+#
+# Environment:
+#   REGRESS_BASELINE   result file to compare against (default: none)
+#   REGRESS_TOLERANCE  allowed degradation in percent (default: 10)
+#   REGRESS_LATENCY_TOLERANCE  the same for p99 latencies (default: 50)
+#   REGRESS_OUT        result file (default: regress-<commit>.json)
+#   BENCH_TIME, BENCH_WARMUP, BENCH_PORT as for run-bench.sh
+
+PEPSAL=${1:?pepsal binary}
+PEPBENCH=${2:?pepbench binary}
+MICRO=${3:?micro binary}
+TOLERANCE=${REGRESS_TOLERANCE:-10}
+LATENCY_TOLERANCE=${REGRESS_LATENCY_TOLERANCE:-50}
+RUN_BENCH=$(dirname "$0")/run-bench.sh
+FORMAT_VERSION=1
+
+commit=$(git -C "$(dirname "$0")" describe --always --dirty 2>/dev/null)
+commit=${commit:-unknown}
+OUT=${REGRESS_OUT:-regress-$commit.json}
+
+# Metrics gated on: test, key field, metric, which way is better.
+# Nested fields are written parent.child.
+METRICS="
+throughput flows mbps higher
+churn rate conns_per_s higher
+churn rate total_us.p99 lower
+churn rate ttfb_us.p99 lower
+soak conns proxy_rss_per_conn_b lower
+soak conns echo_us.p99 lower
+micro-pepbuf ops ns_per_op lower
+micro-pepqueue producers ns_per_item lower
+micro-syntab entries add_ns lower
+micro-syntab entries find_hit_ns lower
+micro-syntab entries delete_ns lower
+"
+
+# Value of field $2 (parent.child for nested objects) in JSON line $1
+json_get() {
+	local line=$1 field=${2##*.} parent
+
+	if [ "$field" != "$2" ]; then
+		parent=${2%%.*}
+		line=$(sed -n "s/.*\"$parent\":{\([^}]*\)}.*/\1/p" <<<"$line")
+	fi
+	sed -n "s/.*\"$field\":\"\{0,1\}\([^,\"}]*\).*/\1/p" <<<"$line"
+}
+
+results=$(mktemp)
+trap 'rm -f "$results"' EXIT
+
+# Fixed parameters, so that results of different commits are comparable
+BENCH_TESTS="throughput churn soak fairness" BENCH_FLOWS="1 100" BENCH_RATES="1000" \
+	BENCH_SOAK_CONNS=2000 BENCH_SOAK_RATE=1000 BENCH_SOAK_KEEPALIVE=1 \
+	BENCH_SOAK_TIME=${BENCH_TIME:-10} BENCH_SOAK_INTERVAL=${BENCH_TIME:-10} \
+	BENCH_OUT="$results" "$RUN_BENCH" "$PEPSAL" "$PEPBENCH" >/dev/null || exit 1
+# The soak test reports during the ramp up too, keep the last line only
+grep -v '"test":"soak"' "$results" >"$results.tmp"
+grep '"test":"soak"' "$results" | tail -1 >>"$results.tmp"
+mv "$results.tmp" "$results"
+
+# The microbenchmarks use fixed seeds
+"$MICRO" -n 2000000 -m 100000 |
+	sed 's/^{"bench":"\([a-z]*\)",/{"test":"micro-\1",/' >>"$results" ||
+	exit 1
+
+{
+	printf '{"version":%d,"commit":"%s","date":"%s","results":[\n' \
+		$FORMAT_VERSION "$commit" "$(date -u +%Y-%m-%dT%H:%M:%SZ)"
+	sed '$!s/$/,/' "$results"
+	printf ']}\n'
+} >"$OUT"
+echo "results stored in $OUT"
+
+[ -z "$REGRESS_BASELINE" ] && exit 0
+if ! grep -q "^{\"version\":$FORMAT_VERSION," "$REGRESS_BASELINE"; then
+	echo "$REGRESS_BASELINE: not a version $FORMAT_VERSION result file" >&2
+	exit 1
+fi
+
+report=$(while read test key metric better; do
+	[ -z "$test" ] && continue
+	grep "^{\"test\":\"$test\"" "$OUT" | while read line; do
+		keyval=$(json_get "$line" $key)
+		cur=$(json_get "$line" $metric)
+		base=$(grep "^{\"test\":\"$test\".*\"$key\":$keyval[,}]" \
+			"$REGRESS_BASELINE" | head -1)
+		[ -z "$base" ] && continue
+		base=$(json_get "$base" $metric)
+		[ -z "$cur" ] || [ -z "$base" ] && continue
+		tol=$TOLERANCE
+		[ "${metric##*.}" = p99 ] && tol=$LATENCY_TOLERANCE
+
+		awk -v cur=$cur -v base=$base -v tol=$tol -v better=$better \
+			-v name="$test $key=$keyval $metric" 'BEGIN {
+			change = base ? (cur - base) * 100 / base : 0
+			worse = (better == "higher") ? -change : change
+			printf "%-10s %-45s %12.2f -> %12.2f (%+.1f%%, max %+d%%)\n",
+				(worse > tol) ? "REGRESSION" : "ok", name, base, cur, change,
+				(better == "higher") ? -tol : tol
+		}'
+	done
+done <<<"$METRICS")
+echo "$report"
+
+if grep -q "^REGRESSION" <<<"$report"; then
+	echo "performance regression against $REGRESS_BASELINE" >&2
+	exit 1
+fi
+echo "no regression against $REGRESS_BASELINE"
@@ -0,0 +1,362 @@
+#!/bin/bash
+#
+# Loopback benchmarks of pepsal, see "make bench".
+#
+# pepsal runs with a static destination (-D), so neither TPROXY rules
+# nor root are needed. Every run prints one JSON line, tagged with the
+# name of the test:
+#
+#   throughput  pepbench source -> pepsal -> pepbench sink, for every
+#               number of flows in BENCH_FLOWS: aggregate throughput,
+#               Jain's fairness index over the flows, the spread of
+#               per-flow rates and the CPU time pepsal used per GB.
+#   churn       pepbench churn -> pepsal -> pepbench server, for every
+#               rate in BENCH_RATES: short request/response connections,
+#               sustained connections per second, connect, first byte
+#               and completion latency percentiles and pepsal RSS growth.
+#   link        pepbench source -> [pepsal ->] linkem -> pepbench sink, for
+#               every link profile in BENCH_LINKS: goodput over the
+#               emulated link without pepsal ("direct") and with it
+#               ("split"), each next to the limit linkem puts on it. linkem
+#               terminates TCP, so the end hosts' congestion control is not
+#               emulated: the window on the link is BENCH_HOST_WINDOW when
+#               the end hosts talk directly, BENCH_PEP_WINDOW when pepsal
+#               sends over the link, and a run can't do better than that
+#               window per RTT or the link rate. The ratio of the two
+#               goodputs is set by these parameters, not measured; what a
+#               run measures is how far below its limit jitter, loss and
+#               pepsal's relaying keep it.
+#   hol         pepbench source -> pepsal -> pepbench sink with
+#               BENCH_HOL_FLOWS fast flows and, for every count in
+#               BENCH_HOL_SLOW, that many slow consumers the sink reads at
+#               BENCH_HOL_RATE bytes/s (0: never, as a stalled egress).
+#               Throughput and longest stall ("gap_ms") of the fast flows:
+#               one stuck peer must not delay the others.
+#   fairness    pepbench source -> pepsal -> pepbench sink with
+#               BENCH_FAIR_FLOWS flows from one client, for every pepsal
+#               configuration in BENCH_FAIR_CONFIGS: throughput and Jain's
+#               fairness index over the flows, which must be at least
+#               BENCH_FAIR_MIN. The defaults limit the terminal, alone and
+#               with per-connection pacing or deficit round-robin: the
+#               flows share the terminal's token bucket.
+#   soak        pepbench soak -> pepsal -> pepbench echo: BENCH_SOAK_CONNS
+#               long-lived connections, idle but for a one byte keepalive
+#               every BENCH_SOAK_KEEPALIVE seconds, held for BENCH_SOAK_TIME
+#               seconds. One JSON line every BENCH_SOAK_INTERVAL seconds:
+#               pepsal RSS and kernel TCP memory, both per connection, CPU
+#               of pepsal and of its poller thread, keepalive echo latency.
+#               Not run by default, it is meant to run for hours.
+#
+# Usage: run-bench.sh PEPSAL PEPBENCH [LINKEM]
+#
+# Exits with 1 if a fairness check failed.
+#
+# Environment:
+#   BENCH_TESTS    tests to run (default: "throughput churn hol fairness")
+#   BENCH_FLOWS    flow counts of the throughput test
+#                  (default: "1 10 100 1000 10000")
+#   BENCH_RATES    connections per second of the churn test
+#                  (default: "100 1000 5000")
+#   BENCH_RESPONSE response size of the churn test (default: 16384)
+#   BENCH_LINKS    link profiles name:rtt ms:Mbit/s[:jitter ms]
+#                  (default: "geo:600:20 leo:40:100:5")
+#   BENCH_LOSS     packet loss of the link test, in percent (default: 0)
+#   BENCH_LINK_FLOWS flows of the link test (default: 1)
+#   BENCH_HOST_WINDOW window of the end hosts (default: 65536)
+#   BENCH_PEP_WINDOW window of pepsal (default: twice the BDP of the link)
+#   BENCH_HOL_FLOWS fast flows of the hol test (default: 100)
+#   BENCH_HOL_SLOW slow consumer counts of the hol test (default: "0 1 10 100")
+#   BENCH_HOL_RATE bytes/s read from each slow consumer (default: 0)
+#   BENCH_FAIR_FLOWS flows of the fairness test (default: 10)
+#   BENCH_FAIR_CONFIGS pepsal configurations of the fairness test, options
+#                  separated by commas (default: "terminal_rate=80000
+#                  terminal_rate=80000,pacing_rate=40000
+#                  terminal_rate=80000,drr_quantum=65536")
+#   BENCH_FAIR_MIN lowest acceptable fairness index (default: 0.9)
+#   BENCH_SOAK_CONNS connections of the soak test, up to 16384 (default: 10000)
+#   BENCH_SOAK_RATE  connections opened per second (default: 1000)
+#   BENCH_SOAK_KEEPALIVE seconds between keepalives (default: 30)
+#   BENCH_SOAK_TIME  seconds the connections are held (default: 3600)
+#   BENCH_SOAK_INTERVAL seconds between reports (default: 60)
+#   BENCH_TIME     measurement seconds per run (default: 10)
+#   BENCH_WARMUP   seconds before measuring (default: 2)
+#   BENCH_PORT     pepsal port, the sink uses BENCH_PORT + 1 and linkem
+#                  BENCH_PORT + 2 (default: 15000)
+#   BENCH_OUT      file the JSON lines are appended to (default: none)
+#   PEPSAL_ARGS    extra pepsal options
+
+PEPSAL=${1:?pepsal binary}
+PEPBENCH=${2:?pepbench binary}
+LINKEM=${3:-$(dirname "$PEPBENCH")/linkem}
+TESTS=${BENCH_TESTS:-"throughput churn hol fairness"}
+FLOWS=${BENCH_FLOWS:-"1 10 100 1000 10000"}
+RATES=${BENCH_RATES:-"100 1000 5000"}
+RESPONSE=${BENCH_RESPONSE:-16384}
+LINKS=${BENCH_LINKS:-"geo:600:20 leo:40:100:5"}
+LOSS=${BENCH_LOSS:-0}
+LINK_FLOWS=${BENCH_LINK_FLOWS:-1}
+HOST_WINDOW=${BENCH_HOST_WINDOW:-65536}
+HOL_FLOWS=${BENCH_HOL_FLOWS:-100}
+HOL_SLOW=${BENCH_HOL_SLOW:-"0 1 10 100"}
+HOL_RATE=${BENCH_HOL_RATE:-0}
+FAIR_FLOWS=${BENCH_FAIR_FLOWS:-10}
+FAIR_CONFIGS=${BENCH_FAIR_CONFIGS:-"terminal_rate=80000
+	terminal_rate=80000,pacing_rate=40000
+	terminal_rate=80000,drr_quantum=65536"}
+FAIR_MIN=${BENCH_FAIR_MIN:-0.9}
+SOAK_CONNS=${BENCH_SOAK_CONNS:-10000}
+SOAK_RATE=${BENCH_SOAK_RATE:-1000}
+SOAK_KEEPALIVE=${BENCH_SOAK_KEEPALIVE:-30}
+SOAK_TIME=${BENCH_SOAK_TIME:-3600}
+SOAK_INTERVAL=${BENCH_SOAK_INTERVAL:-60}
+TIME=${BENCH_TIME:-10}
+WARMUP=${BENCH_WARMUP:-2}
+PORT=${BENCH_PORT:-15000}
+failed=0
+SINK_PORT=$((PORT + 1))
+LINK_PORT=$((PORT + 2))
+
+# Two descriptors per flow in pepsal, one in the source and the sink
+ulimit -n $(ulimit -Hn) 2>/dev/null
+
+pids=""
+cleanup() {
+	[ -n "$pids" ] && kill $pids 2>/dev/null
+	wait 2>/dev/null
+	pids=""
+}
+trap cleanup EXIT INT TERM
+
+# Wait until something listens on TCP port $1, without connecting to it
+wait_port() {
+	local i hex=$(printf "%04X" $1)
+	for i in $(seq 50); do
+		grep -q "^ *[0-9]*: [0-9A-F]*:$hex [0-9A-F]*:0000 0A" /proc/net/tcp &&
+			return 0
+		sleep 0.1
+	done
+	echo "nothing listens on port $1" >&2
+	return 1
+}
+
+# Start pepsal for up to $1 connections to port $2 (default: the sink),
+# its pid goes to $pep
+start_pepsal() {
+	local conns=$(($1 < 128 ? 128 : $1))
+
+	[ $conns -gt 16384 ] && conns=16384
+	"$PEPSAL" -p $PORT -c $conns -D 127.0.0.1:${2:-$SINK_PORT} $PEPSAL_ARGS \
+		2>>/tmp/pepbench-pepsal.$$ &
+	pep=$!
+	pids="$pids $pep"
+}
+
+# Print the JSON result in file $2 tagged with test name $1
+report() {
+	local line
+
+	line=$(sed "s/^{/{\"test\":\"$1\",/" "$2")
+	echo "$line"
+	[ -n "$BENCH_OUT" ] && echo "$line" >>"$BENCH_OUT"
+	rm -f "$2"
+}
+
+run_throughput() {
+	local n=$1 result sink
+
+	if [ $n -gt 16384 ]; then
+		echo "skipping $n flows: pepsal supports up to 16384" >&2
+		return
+	fi
+
+	start_pepsal $n
+	result=$(mktemp)
+	"$PEPBENCH" sink -l 127.0.0.1:$SINK_PORT -n $n -w $WARMUP -t $TIME \
+		-P $pep >"$result" &
+	sink=$!
+	pids="$pids $sink"
+
+	wait_port $PORT && wait_port $SINK_PORT || exit 1
+	"$PEPBENCH" source -c 127.0.0.1:$PORT -n $n -t $((WARMUP + TIME + 5)) &
+	pids="$pids $!"
+
+	wait $sink
+	report throughput "$result"
+	cleanup
+}
+
+run_churn() {
+	local rate=$1 result
+
+	start_pepsal 16384
+	"$PEPBENCH" server -l 127.0.0.1:$SINK_PORT -s $RESPONSE &
+	pids="$pids $!"
+
+	wait_port $PORT && wait_port $SINK_PORT || exit 1
+	result=$(mktemp)
+	"$PEPBENCH" churn -c 127.0.0.1:$PORT -r $rate -w $WARMUP -t $TIME \
+		-P $pep >"$result"
+	report churn "$result"
+	cleanup
+}
+
+# Goodput in Mbit/s of $LINK_FLOWS flows from port $1 to the sink,
+# through linkem on port $LINK_PORT with options $2
+link_goodput() {
+	local result sink
+
+	"$LINKEM" -l 127.0.0.1:$LINK_PORT -c 127.0.0.1:$SINK_PORT $2 &
+	pids="$pids $!"
+	result=$(mktemp)
+	"$PEPBENCH" sink -l 127.0.0.1:$SINK_PORT -n $LINK_FLOWS -w $WARMUP \
+		-t $TIME >"$result" &
+	sink=$!
+	pids="$pids $sink"
+
+	wait_port $1 && wait_port $LINK_PORT && wait_port $SINK_PORT || exit 1
+	"$PEPBENCH" source -c 127.0.0.1:$1 -n $LINK_FLOWS \
+		-t $((WARMUP + TIME + 5)) &
+	pids="$pids $!"
+
+	wait $sink
+	sed -n 's/.*"mbps":\([0-9.]*\).*/\1/p' "$result"
+	rm -f "$result"
+	cleanup
+}
+
+run_link() {
+	local name rtt mbit jitter pep_window link direct split result
+
+	IFS=: read name rtt mbit jitter <<<"$1"
+	pep_window=${BENCH_PEP_WINDOW:-$((rtt * mbit * 250))}
+	link="-r $rtt -b $mbit -j ${jitter:-0} -p $LOSS"
+
+	direct=$(link_goodput $LINK_PORT "$link -W $HOST_WINDOW")
+	start_pepsal $LINK_FLOWS $LINK_PORT
+	split=$(link_goodput $PORT "$link -W $pep_window")
+	cleanup
+
+	result=$(mktemp)
+	printf '{"profile":"%s","rtt_ms":%d,"mbit":%d,"jitter_ms":%d,' \
+		$name $rtt $mbit ${jitter:-0} >"$result"
+	printf '"loss":%s,"flows":%d,"host_window":%d,"pep_window":%d,' \
+		$LOSS $LINK_FLOWS $HOST_WINDOW $pep_window >>"$result"
+	# linkem's window is per connection
+	awk -v d=${direct:-0} -v s=${split:-0} -v rtt=$rtt -v mbit=$mbit \
+		-v n=$LINK_FLOWS -v hw=$HOST_WINDOW -v pw=$pep_window '
+		function limit(w) {
+			w = n * w * 8 / (rtt * 1000)
+			return (w < mbit) ? w : mbit
+		}
+		BEGIN { printf "\"direct_mbps\":%.1f,\"direct_limit_mbps\":%.1f," \
+			"\"split_mbps\":%.1f,\"split_limit_mbps\":%.1f}\n", \
+			d, limit(hw), s, limit(pw) }' >>"$result"
+	report link "$result"
+}
+
+run_hol() {
+	local slow=$1 n=$((HOL_FLOWS + $1)) result sink
+
+	start_pepsal $n
+	result=$(mktemp)
+	"$PEPBENCH" sink -l 127.0.0.1:$SINK_PORT -n $n -s $slow -R $HOL_RATE \
+		-w $WARMUP -t $TIME -P $pep >"$result" &
+	sink=$!
+	pids="$pids $sink"
+
+	wait_port $PORT && wait_port $SINK_PORT || exit 1
+	"$PEPBENCH" source -c 127.0.0.1:$PORT -n $n -t $((WARMUP + TIME + 5)) &
+	pids="$pids $!"
+
+	wait $sink
+	sed -i "s/^{/{\"slow_rate\":$HOL_RATE,/" "$result"
+	report hol "$result"
+	cleanup
+}
+
+run_fairness() {
+	local config=$1 conf result sink jain
+
+	conf=$(mktemp)
+	tr , '\n' <<<"$config" >"$conf"
+	PEPSAL_ARGS="$PEPSAL_ARGS -F $conf" start_pepsal $FAIR_FLOWS
+	result=$(mktemp)
+	"$PEPBENCH" sink -l 127.0.0.1:$SINK_PORT -n $FAIR_FLOWS -w $WARMUP \
+		-t $TIME -P $pep >"$result" &
+	sink=$!
+	pids="$pids $sink"
+
+	wait_port $PORT && wait_port $SINK_PORT || exit 1
+	"$PEPBENCH" source -c 127.0.0.1:$PORT -n $FAIR_FLOWS \
+		-t $((WARMUP + TIME + 5)) &
+	pids="$pids $!"
+
+	wait $sink
+	jain=$(sed -n 's/.*"jain":\([0-9.]*\).*/\1/p' "$result")
+	if awk -v j=${jain:-0} -v min=$FAIR_MIN 'BEGIN { exit !(j < min) }'; then
+		echo "fairness index ${jain:-0} below $FAIR_MIN with $config" >&2
+		failed=1
+	fi
+	sed -i "s/^{/{\"config\":\"$config\",\"min_jain\":$FAIR_MIN,/" "$result"
+	report fairness "$result"
+	rm -f "$conf"
+	cleanup
+}
+
+run_soak() {
+	local result
+
+	start_pepsal $SOAK_CONNS
+	"$PEPBENCH" echo -l 127.0.0.1:$SINK_PORT &
+	pids="$pids $!"
+
+	wait_port $PORT && wait_port $SINK_PORT || exit 1
+	result=$(mktemp)
+	"$PEPBENCH" soak -c 127.0.0.1:$PORT -n $SOAK_CONNS -r $SOAK_RATE \
+		-k $SOAK_KEEPALIVE -t $SOAK_TIME -i $SOAK_INTERVAL -P $pep |
+		while read line; do
+			echo "$line" >"$result"
+			report soak "$result"
+		done
+	rm -f "$result"
+	cleanup
+}
+
+for test in $TESTS; do
+	case $test in
+		throughput)
+			for n in $FLOWS; do
+				run_throughput $n
+			done
+			;;
+		churn)
+			for rate in $RATES; do
+				run_churn $rate
+			done
+			;;
+		link)
+			for profile in $LINKS; do
+				run_link $profile
+			done
+			;;
+		hol)
+			for slow in $HOL_SLOW; do
+				run_hol $slow
+			done
+			;;
+		fairness)
+			for config in $FAIR_CONFIGS; do
+				run_fairness $config
+			done
+			;;
+		soak)
+			run_soak
+			;;
+		*)
+			echo "unknown test $test" >&2
+			exit 1
+			;;
+	esac
+done
+rm -f /tmp/pepbench-pepsal.$$
+exit $failed
@@ -153,6 +153,20 @@ unsigned int
 hashtable_count(struct hashtable *h);
 
 
+/*****************************************************************************
+ * hashtable_chain_stats
+
+ * @name        hashtable_chain_stats
+ * @param   h   the hashtable
+ * @param   used    number of buckets holding at least one item
+ * @param   longest length of the longest collision chain
+ * @return      the number of buckets of the hashtable
+ */
+unsigned int
+hashtable_chain_stats(struct hashtable *h, unsigned int *used,
+				unsigned int *longest);
+
+
 /*****************************************************************************
  * hashtable_destroy
 
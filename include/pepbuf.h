@@ -32,7 +32,8 @@ struct pep_buffer {
 #define PEPBUF_SPACE_LEFT(pbuf)   (pbuf)->space_left
 #define PEPBUF_SPACE_FILLED(pbuf) (pbuf)->rbytes
 
-int pepbuf_init(struct pep_buffer *pbuf);
+size_t pepbuf_size(size_t size);
+int pepbuf_init(struct pep_buffer *pbuf, size_t size);
 void pepbuf_deinit(struct pep_buffer *pbuf);
 void pepbuf_update_rpos(struct pep_buffer *pbuf, ssize_t rb);
 void pepbuf_update_wpos(struct pep_buffer *pbuf, ssize_t wb);
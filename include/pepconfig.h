@@ -0,0 +1,75 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPCONFIG_H
+#define __PEPCONFIG_H
+
+#include <stdio.h>
+#include <time.h>
+#include "pepdefs.h"
+#include "atomic.h"
+#include "peppolicy.h"
+#include "pepsockbuf.h"
+
+/*
+ * Tunables that can be reloaded without a restart (SIGHUP or the
+ * "reload" control command). A reload builds a new configuration from
+ * the command line options, the configuration file (-F) and the policy
+ * file (-x), then publishes it. The published configuration is never
+ * modified: new connections take a reference to the current one and
+ * keep it, and the rules their policy points to, until they are freed.
+ * Old configurations go away with their last connection.
+ *
+ * The configuration file has one "key=value" per line, with the keys
+ * gcc_interval, plifetime, log_interval (seconds), cc_egress,
+ * cc_ingress, mark_egress, mark_ingress, mtu_ingress, relay_buf, and
+ * the socket buffer sizing settings (see pepsockbuf.h) link_rate
+ * (kbit/s), link_rtt (ms), sockbuf_auto (0 or 1), sockbuf_min,
+ * sockbuf_max and sockbuf_budget (bytes), the rate limits (see
+ * peprate.h) pacing_rate and terminal_rate (kbit/s) and terminal_burst
+ * (bytes), the fair scheduling settings (see pepdrr.h) drr_quantum
+ * (bytes) and drr_prefix (bits), mem_budget (bytes) and pressure (0 or
+ * 1, see peppressure.h). Lines starting with # are comments.
+ */
+
+struct pep_config {
+		int gcc_interval;
+		int pending_conn_lifetime;
+		int log_interval;
+		int ingress_mtu;                    /* 0 if not set */
+		unsigned int mark_egress;           /* 0 if not set */
+		unsigned int mark_ingress;
+		char cc_egress[PEPPOLICY_CC_SZ];    /* "" if not set */
+		char cc_ingress[PEPPOLICY_CC_SZ];
+		size_t relay_buf;                   /* 0: PEPBUF_PAGES pages */
+		unsigned int link_rate;             /* kbit/s, 0 if no profile */
+		unsigned int link_rtt;              /* ms */
+		unsigned int pacing_rate;           /* kbit/s per connection, 0: none */
+		unsigned int terminal_rate;         /* kbit/s per client address */
+		unsigned int terminal_burst;        /* bytes, 0: default */
+		size_t drr_quantum;                 /* bytes per round, 0: no DRR */
+		int drr_prefix;                     /* client prefix length of groups */
+		int sockbuf_auto;
+		struct pepsockbuf_limits sockbuf;
+		size_t mem_budget;                  /* bytes, 0: none, see pepmem.h */
+		int pressure;                       /* react to memory pressure */
+		struct peppolicy_table *policies;   /* NULL without -x */
+		unsigned int generation;
+		time_t loaded;
+		atomic_t refcnt;
+};
+
+int pepconfig_parse(struct pep_config *cfg, const char *path, char *err,
+				size_t errlen);
+void pepconfig_publish(struct pep_config *cfg);
+struct pep_config *pepconfig_get(void);
+void pepconfig_put(struct pep_config *cfg);
+void pepconfig_dump_json(FILE *file, struct pep_config *cfg);
+
+#endif /* __PEPCONFIG_H */
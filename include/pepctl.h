@@ -0,0 +1,39 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPCTL_H
+#define __PEPCTL_H
+
+#include <stdio.h>
+#include "pepdefs.h"
+
+/* Maximal number of commands the control socket may serve */
+#define PEPCTL_MAX_COMMANDS 32
+
+/* Maximal length of a request line */
+#define PEPCTL_REQUEST_SZ 256
+
+/* Maximal number of words in a request */
+#define PEPCTL_MAX_ARGS 8
+
+/*
+ * Command handler. @argv[0] is the command name. The reply must be
+ * written to @out as a single line of JSON; it's sent to the client
+ * only after the handler returns, so handlers may hold locks while
+ * writing without depending on the client's speed.
+ */
+typedef void (*pepctl_handler_t)(FILE *out, int argc, char *argv[]);
+
+int pepctl_register(const char *name, const char *help,
+				pepctl_handler_t handler);
+int pepctl_init(const char *path);
+void pepctl_json_string(FILE *out, const char *str, size_t max);
+void *pepctl_loop(void *unused);
+
+#endif /* __PEPCTL_H */
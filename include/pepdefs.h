@@ -8,7 +8,8 @@
 
 /* Minimal and maximal number of simultaneous connections */
 #define PEP_MIN_CONNS 128
-#define PEP_MAX_CONNS 4096
+#define PEP_MAX_CONNS 16384
+#define PEP_DEFAULT_CONNS 2112
 
 /* Default port number of pepsal listener */
 #define PEP_DEFAULT_PORT 5000
@@ -28,6 +29,9 @@
  */
 #define POLLER_NEWCONN_SIG SIGUSR1
 
+/* Signal that makes pepsal dump its flight recorder */
+#define FLIGHTREC_DUMP_SIG SIGUSR2
+
 /* Number of pages reserved for send/receive buffers */
 #define PEPBUF_PAGES 2
 
@@ -0,0 +1,65 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPDRR_H
+#define __PEPDRR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "pepdefs.h"
+#include "pepreg.h"
+
+/*
+ * Deficit round-robin across subscribers. Connections are grouped by
+ * client address, masked to drr_prefix bits so that a group can be a
+ * whole terminal subnet. Each batch the poller hands to the workers
+ * is a round: every group with ready connections earns drr_quantum
+ * bytes of deficit, shared equally by its ready connections, and a
+ * connection stops writing for the round once it has used its share.
+ * A group's unused deficit carries over to the next round only while
+ * the group stays backlogged, i.e. one of its connections ran out of
+ * its share; otherwise it starts over from zero.
+ *
+ * So in every round each busy subscriber moves about drr_quantum
+ * bytes, however many connections it has: one subscriber's bulk
+ * transfers can delay another's interactive traffic by one round at
+ * most. Leftover work is picked up by the next round, as poll() keeps
+ * reporting sockets with pending data.
+ *
+ * Groups are registered by prefix (pepreg.h), created by the listener
+ * and freed with their last connection. Their scheduling state is only
+ * touched by the poller, between batches; the workers only consume
+ * the share of the connection they are serving.
+ */
+
+#define PEPDRR_MIN_SHARE   1448    /* don't write less than a segment */
+
+struct pepdrr_group {
+		struct pepreg_entry entry;  /* keyed by prefix and length */
+		uint32_t prefix;            /* masked client address, host order */
+		unsigned char len;          /* prefix length */
+		size_t quantum;             /* bytes per round */
+		int64_t deficit;            /* negative if a share was overrun */
+		uint64_t round;             /* last round it was ready in */
+		unsigned int ready;         /* ready connections in that round */
+		int backlogged;             /* a connection ran out of its share */
+		uint64_t bytes;             /* bytes written */
+		uint64_t rounds;            /* rounds it was served in */
+		uint64_t limited;           /* connections stopped by their share */
+};
+
+struct pepdrr_group *pepdrr_get(uint32_t addr, unsigned int len, size_t quantum);
+void pepdrr_put(struct pepdrr_group *group);
+void pepdrr_ready(struct pepdrr_group *group, uint64_t round);
+size_t pepdrr_share(struct pepdrr_group *group);
+void pepdrr_charge(struct pepdrr_group *group, size_t bytes, int limited);
+void pepdrr_dump_json(FILE *file);
+
+#endif /* __PEPDRR_H */
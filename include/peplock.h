@@ -0,0 +1,179 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPLOCK_H
+#define __PEPLOCK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "pepdefs.h"
+#include "pepstat.h"
+
+/*
+ * Optional lock instrumentation. When enabled (peplock_enabled), every
+ * acquisition of an instrumented lock first tries the lock; only if
+ * that fails the acquisition is counted as contended and the time
+ * spent blocking is recorded. Hold time is recorded on release, time
+ * spent in pthread_cond_wait() is not counted as held.
+ * When disabled, the wrappers only cost a test of peplock_enabled.
+ */
+
+enum peplock_id {
+		PEPLOCK_SYNTAB_READ = 0,
+		PEPLOCK_SYNTAB_WRITE,
+		PEPLOCK_ACTIVE_QUEUE,
+		PEPLOCK_READY_QUEUE,
+		PEPLOCK_NR,
+};
+
+struct peplock_stats {
+		uint64_t acquired;
+		uint64_t contended;
+		uint64_t wait[PEPHIST_BUCKETS];
+		uint64_t hold[PEPHIST_BUCKETS];
+};
+
+/* Lock statistics of one thread, indexed like pepstat_threads */
+struct peplock_thread {
+		uint64_t held_since[PEPLOCK_NR];
+		struct peplock_stats stats[PEPLOCK_NR];
+} __attribute__((aligned(64)));
+
+/* Merged view of one lock */
+struct peplock_totals {
+		uint64_t acquired;
+		uint64_t contended;
+		struct pephist wait;
+		struct pephist hold;
+};
+
+extern int peplock_enabled;
+extern struct peplock_thread peplock_threads[PEPSTAT_MAX_THREADS];
+
+static __inline struct peplock_thread *peplock_self(void)
+{
+		return &peplock_threads[pepstat_self - pepstat_threads];
+}
+
+/* @start is 0 if the lock was taken without blocking */
+static __inline void peplock_acquired(enum peplock_id id, uint64_t start)
+{
+		struct peplock_thread *self = peplock_self();
+		struct peplock_stats *st = &self->stats[id];
+		uint64_t now = pep_clock_ns();
+
+		st->acquired++;
+		if (start) {
+				st->contended++;
+				st->wait[pephist_bucket(now - start)]++;
+		}
+		self->held_since[id] = now;
+}
+
+static __inline void peplock_released(enum peplock_id id)
+{
+		struct peplock_thread *self = peplock_self();
+
+		self->stats[id].hold[pephist_bucket(pep_clock_ns() -
+								self->held_since[id])]++;
+}
+
+static __inline void peplock_mutex_lock(pthread_mutex_t *mutex,
+				enum peplock_id id)
+{
+		uint64_t start;
+
+		if (!peplock_enabled) {
+				pthread_mutex_lock(mutex);
+				return;
+		}
+		if (pthread_mutex_trylock(mutex) == 0) {
+				peplock_acquired(id, 0);
+				return;
+		}
+
+		start = pep_clock_ns();
+		pthread_mutex_lock(mutex);
+		peplock_acquired(id, start);
+}
+
+static __inline void peplock_mutex_unlock(pthread_mutex_t *mutex,
+				enum peplock_id id)
+{
+		if (peplock_enabled) {
+				peplock_released(id);
+		}
+		pthread_mutex_unlock(mutex);
+}
+
+static __inline void peplock_cond_wait(pthread_cond_t *cond,
+				pthread_mutex_t *mutex, enum peplock_id id)
+{
+		if (!peplock_enabled) {
+				pthread_cond_wait(cond, mutex);
+				return;
+		}
+
+		peplock_released(id);
+		pthread_cond_wait(cond, mutex);
+		peplock_self()->held_since[id] = pep_clock_ns();
+}
+
+static __inline void peplock_rdlock(pthread_rwlock_t *lock,
+				enum peplock_id id)
+{
+		uint64_t start;
+
+		if (!peplock_enabled) {
+				pthread_rwlock_rdlock(lock);
+				return;
+		}
+		if (pthread_rwlock_tryrdlock(lock) == 0) {
+				peplock_acquired(id, 0);
+				return;
+		}
+
+		start = pep_clock_ns();
+		pthread_rwlock_rdlock(lock);
+		peplock_acquired(id, start);
+}
+
+static __inline void peplock_wrlock(pthread_rwlock_t *lock,
+				enum peplock_id id)
+{
+		uint64_t start;
+
+		if (!peplock_enabled) {
+				pthread_rwlock_wrlock(lock);
+				return;
+		}
+		if (pthread_rwlock_trywrlock(lock) == 0) {
+				peplock_acquired(id, 0);
+				return;
+		}
+
+		start = pep_clock_ns();
+		pthread_rwlock_wrlock(lock);
+		peplock_acquired(id, start);
+}
+
+static __inline void peplock_rwunlock(pthread_rwlock_t *lock,
+				enum peplock_id id)
+{
+		if (peplock_enabled) {
+				peplock_released(id);
+		}
+		pthread_rwlock_unlock(lock);
+}
+
+void peplock_merge(enum peplock_id id, struct peplock_totals *totals);
+void peplock_dump_json(FILE *file, struct peplock_totals *prev);
+
+#endif /* __PEPLOCK_H */
@@ -0,0 +1,52 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPLOG_H
+#define __PEPLOG_H
+
+#include <stdint.h>
+#include "pepdefs.h"
+
+/*
+ * Asynchronous debug log. Each thread appends records to its own
+ * lock-free ring of PEPLOG_RING_SIZE records, a background thread
+ * drains the rings and does the expensive part (address formatting,
+ * stderr and syslog). If a ring is full, the record is dropped and
+ * counted instead of blocking the caller.
+ */
+
+/* Number of records per thread, must be a power of two */
+#define PEPLOG_RING_SIZE 512
+
+/* Maximal length of a formatted message */
+#define PEPLOG_MSG_SZ 200
+
+/* How long the drainer sleeps when all rings are empty (ms) */
+#define PEPLOG_DRAIN_INTERVAL_MS 10
+
+struct peplog_record {
+		uint32_t seq;
+		unsigned short port;
+		int addr;
+		int has_addr;
+		uint64_t ts;
+		const char *function;
+		char msg[PEPLOG_MSG_SZ];
+};
+
+void peplog_debug(const char *function, const char *fmt, ...)
+		__attribute__((format(printf, 2, 3)));
+void peplog_debug_dp(const char *function, int addr, unsigned short port,
+				const char *fmt, ...)
+		__attribute__((format(printf, 4, 5)));
+uint64_t peplog_dropped(void);
+void peplog_flush(void);
+void *peplog_loop(void *unused);
+
+#endif /* __PEPLOG_H */
@@ -0,0 +1,50 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPMEM_H
+#define __PEPMEM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "pepdefs.h"
+
+/*
+ * Accounting of the memory pepsal uses for relaying, checked against
+ * the global budget (mem_budget, see pepconfig.h):
+ *
+ *   relay    relay buffers allocated, exact
+ *   queued   data in the kernel send queues of the proxies' sockets,
+ *            sampled by the timer thread every second
+ *   sockbuf  socket buffer sizes set by pepsal (pepsockbuf.h); a limit
+ *            rather than memory in use, not part of "used"
+ *
+ * Allocating a larger relay buffer or growing a socket buffer is only
+ * allowed while used memory plus the new bytes fits in the budget.
+ * Above the budget, connections whose backlog exceeds their fair share
+ * (budget / open connections) stop reading from the side that fills
+ * it, until memory goes back under 7/8 of the budget or their backlog
+ * under half their share.
+ */
+
+enum pepmem_kind {
+		PEPMEM_RELAY = 0,
+		PEPMEM_QUEUED,
+		PEPMEM_SOCKBUF,
+		PEPMEM_NR,
+};
+
+void pepmem_charge(enum pepmem_kind kind, int64_t bytes);
+void pepmem_set(enum pepmem_kind kind, uint64_t bytes);
+uint64_t pepmem_read(enum pepmem_kind kind);
+uint64_t pepmem_used(void);
+int pepmem_fits(size_t budget, size_t bytes);
+void pepmem_dump_json(FILE *file, size_t budget, int throttled);
+
+#endif /* __PEPMEM_H */
@@ -0,0 +1,82 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPPERF_H
+#define __PEPPERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pepdefs.h"
+#include "pepstat.h"
+
+/*
+ * Hardware counter profiling. Threads doing proxy work open a
+ * perf_event group (cycles, instructions, cache misses) counting
+ * user and kernel time of the thread only, and read it around the
+ * code sections below. Every read is a syscall, so this mode is
+ * meant for benchmarking, not for production.
+ */
+
+enum pepperf_event {
+		PEPPERF_CYCLES = 0,
+		PEPPERF_INSTRUCTIONS,
+		PEPPERF_LLC_MISSES,
+		PEPPERF_EVENTS,
+};
+
+enum pepperf_section {
+		PEPPERF_PROXY_DATA = 0,  /* pep_proxy_data() in both directions */
+		PEPPERF_POLL_REBUILD,    /* prepare_poll_resources() */
+		PEPPERF_ACCEPT,          /* listener: accept() to connect() issued */
+		PEPPERF_NR,
+};
+
+struct pepperf_sample {
+		uint64_t val[PEPPERF_EVENTS];
+};
+
+struct pepperf_counts {
+		uint64_t calls;
+		uint64_t val[PEPPERF_EVENTS];
+};
+
+struct pepperf_thread {
+		struct pepperf_counts sections[PEPPERF_NR];
+} __attribute__((aligned(64)));
+
+/* Merged view of all threads */
+struct pepperf_totals {
+		struct pepperf_counts sections[PEPPERF_NR];
+		uint64_t bytes;
+};
+
+extern int pepperf_enabled;
+
+int pepperf_thread_init(void);
+void pepperf_read(struct pepperf_sample *sample);
+void pepperf_account(enum pepperf_section section,
+				struct pepperf_sample *start);
+void pepperf_dump_json(FILE *file, struct pepperf_totals *prev);
+
+static __inline void pepperf_begin(struct pepperf_sample *sample)
+{
+		if (pepperf_enabled) {
+				pepperf_read(sample);
+		}
+}
+
+static __inline void pepperf_end(enum pepperf_section section,
+				struct pepperf_sample *start)
+{
+		if (pepperf_enabled) {
+				pepperf_account(section, start);
+		}
+}
+
+#endif /* __PEPPERF_H */
@@ -0,0 +1,90 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPPOLICY_H
+#define __PEPPOLICY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pepdefs.h"
+
+/*
+ * Per-subnet policies. A policy file (-x) has one rule per line:
+ *
+ *   # source       destination    settings
+ *   10.1.0.0/16    0.0.0.0/0      name=geo cc_egress=hybla sndbuf=4194304
+ *   *              192.0.2.0/24   mark_egress=2 relay_buf=65536
+ *   10.2.0.0/16    *              link_rate=50000 link_rtt=600
+ *   10.3.0.0/16    *              terminal_rate=20000 pacing_rate=10000
+ *
+ * The table is looked up once per accepted connection. The rule with
+ * the longest matching source prefix wins, among those the one with
+ * the longest matching destination prefix. Settings a rule leaves out
+ * keep the values of the command line options; connections no rule
+ * matches use the command line options only.
+ */
+
+#define PEPPOLICY_NAME_SZ 32
+#define PEPPOLICY_CC_SZ   32
+
+/* Order in which connections give up memory under pressure */
+#define PEPPOLICY_PRIO_LOW    -1
+#define PEPPOLICY_PRIO_NORMAL  0
+#define PEPPOLICY_PRIO_HIGH    1
+
+struct pep_policy {
+		char name[PEPPOLICY_NAME_SZ];
+		char cc_egress[PEPPOLICY_CC_SZ];    /* "" if not set */
+		char cc_ingress[PEPPOLICY_CC_SZ];
+		unsigned int mark_egress;           /* 0 if not set */
+		unsigned int mark_ingress;
+		int mtu_ingress;
+		int sndbuf;
+		int rcvbuf;
+		size_t relay_buf;                   /* bytes of relay buffer per direction */
+		unsigned int link_rate;             /* link profile, kbit/s */
+		unsigned int link_rtt;              /* ms */
+		unsigned int pacing_rate;           /* kbit/s, see peprate.h */
+		unsigned int terminal_rate;         /* kbit/s */
+		unsigned int terminal_burst;        /* bytes */
+		int priority;                       /* PEPPOLICY_PRIO_* */
+		uint32_t src;
+		uint32_t dst;
+		unsigned char src_len;
+		unsigned char dst_len;
+		int line;
+		uint64_t hits;
+};
+
+/*
+ * Binary trie node. The nodes of the source trie point to the root of
+ * a destination trie, the nodes of destination tries point to a rule.
+ * Node 0 is the root of the source trie, so 0 also means "no child".
+ */
+struct peppolicy_node {
+		uint32_t child[2];
+		int32_t value;
+};
+
+struct peppolicy_table {
+		struct peppolicy_node *nodes;
+		unsigned int nr_nodes;
+		unsigned int max_nodes;
+		struct pep_policy *rules;
+		unsigned int nr_rules;
+};
+
+struct peppolicy_table *peppolicy_load(const char *path, char *err,
+				size_t errlen);
+void peppolicy_free(struct peppolicy_table *table);
+struct pep_policy *peppolicy_lookup(struct peppolicy_table *table,
+				uint32_t src, uint32_t dst);
+void peppolicy_dump_json(FILE *file, struct peppolicy_table *table);
+
+#endif /* __PEPPOLICY_H */
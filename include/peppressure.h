@@ -0,0 +1,60 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPPRESSURE_H
+#define __PEPPRESSURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pepdefs.h"
+
+/*
+ * Kernel memory pressure watcher. Once a second the timer samples the
+ * memory PSI (/proc/pressure/memory) and the TCP memory in use
+ * (/proc/net/sockstat) against the tcp_mem thresholds. The resulting
+ * level decides which connections give up buffer memory: at
+ * PEPPRESSURE_SOME idle and low priority connections, at
+ * PEPPRESSURE_HIGH all but high priority ones. Their relay buffers go
+ * back to the default size and their socket buffers down to
+ * sockbuf_min; both are restored when the level falls. A level is
+ * only left once all inputs are below its exit thresholds, so that
+ * buffers don't flap around a threshold.
+ */
+
+enum peppressure_level {
+		PEPPRESSURE_NONE = 0,
+		PEPPRESSURE_SOME,
+		PEPPRESSURE_HIGH,
+};
+
+/* Thresholds, PSI avg10 in percent, TCP memory in percent of tcp_mem[1] */
+#define PEPPRESSURE_PSI_SOME       10
+#define PEPPRESSURE_PSI_HIGH       25
+#define PEPPRESSURE_PSI_FULL_HIGH  5
+#define PEPPRESSURE_TCP_SOME       75
+#define PEPPRESSURE_TCP_HIGH       90
+#define PEPPRESSURE_EXIT_PERCENT   60    /* of the entry thresholds */
+
+/* Seconds without data after which a connection is idle */
+#define PEPPRESSURE_IDLE           10
+
+struct peppressure_sample {
+		double psi_some;        /* avg10, -1 if PSI is unavailable */
+		double psi_full;
+		uint64_t tcp_mem;       /* pages, as in tcp_mem */
+		uint64_t tcp_mem_min;
+		uint64_t tcp_mem_pressure;
+		uint64_t tcp_mem_max;
+		int level;
+};
+
+int peppressure_sample(struct peppressure_sample *sample, int prev_level);
+void peppressure_dump_json(FILE *file, const struct peppressure_sample *sample);
+
+#endif /* __PEPPRESSURE_H */
@@ -14,6 +14,7 @@
 
 #include <pthread.h>
 #include "pepdefs.h"
+#include "peplock.h"
 #include "list.h"
 
 struct pep_queue {
@@ -21,15 +22,17 @@ struct pep_queue {
 		int num_items;
 		pthread_mutex_t mutex;
 		pthread_cond_t condvar;
+		enum peplock_id lock_id;
 };
 
-#define PEPQUEUE_LOCK(pq)   pthread_mutex_lock(&(pq)->mutex)
-#define PEPQUEUE_UNLOCK(pq) pthread_mutex_unlock(&(pq)->mutex)
+#define PEPQUEUE_LOCK(pq)   peplock_mutex_lock(&(pq)->mutex, (pq)->lock_id)
+#define PEPQUEUE_UNLOCK(pq) peplock_mutex_unlock(&(pq)->mutex, (pq)->lock_id)
 
 #define PEPQUEUE_WAKEUP_WAITERS(pq) pthread_cond_signal(&(pq)->condvar)
-#define PEPQUEUE_WAIT(pq) pthread_cond_wait(&(pq)->condvar, &(pq)->mutex)
+#define PEPQUEUE_WAIT(pq)                                               \
+		peplock_cond_wait(&(pq)->condvar, &(pq)->mutex, (pq)->lock_id)
 
-int pepqueue_init(struct pep_queue *pq);
+int pepqueue_init(struct pep_queue *pq, enum peplock_id lock_id);
 void pepqueue_enqueue(struct pep_queue *pq, struct pep_proxy *endp);
 void pepqueue_enqueue_list(struct pep_queue *pq,
 				struct list_head *list, int num_items);
@@ -0,0 +1,71 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPRATE_H
+#define __PEPRATE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pepdefs.h"
+#include "pepreg.h"
+
+/*
+ * Egress rate limiting. Satellite terminals have a provisioned rate:
+ * relaying into the server side sockets faster than that only builds
+ * a queue at the modem, which inflates the RTT of every flow of the
+ * terminal. Two limits apply to the data written to the server side
+ * (egress) sockets, both part of the link profile:
+ *
+ * - pacing_rate caps each connection with SO_MAX_PACING_RATE, the
+ *   kernel spreads its segments over time (TCP internal pacing, or the
+ *   fq qdisc).
+ * - terminal_rate caps all the connections of a client address
+ *   together with a token bucket of terminal_burst bytes. Writes take
+ *   tokens; when there are none left, the endpoint is not polled for
+ *   writing until the bucket has refilled enough, and its relay buffer
+ *   filling up pushes back on the client through TCP flow control.
+ *
+ * The connections of a terminal share its bucket fairly: a write takes
+ * at most the connection's share of the burst, and endpoints that have
+ * to wait are given consecutive time slots, in the order they ran out,
+ * each long enough to earn what the endpoint had to write, up to a
+ * share. While some are waiting, the others queue up behind them rather
+ * than take the tokens refilled for the endpoint whose slot it is.
+ */
+
+#define PEPRATE_MIN_BURST   (16 * 1024)
+#define PEPRATE_MIN_GRANT   1448        /* don't write less than a segment */
+#define PEPRATE_MIN_SHARE   (4 * PEPRATE_MIN_GRANT)
+#define PEPRATE_BURST_MS    20          /* default burst, in ms at the rate */
+
+struct peprate_bucket {
+		struct pepreg_entry entry;  /* keyed by client address */
+		uint32_t addr;              /* client address, host byte order */
+		uint64_t rate;              /* bytes/s */
+		uint64_t burst;             /* bytes */
+		uint64_t tokens;
+		uint64_t stamp;             /* pep_clock_ns() of the last refill */
+		uint64_t bytes;             /* bytes granted */
+		uint64_t deferred;          /* writes deferred for lack of tokens */
+		uint64_t slot;              /* end of the last slot handed out */
+		int conns;                  /* connections sharing the bucket */
+		pthread_mutex_t lock;       /* taken by the workers on every write */
+};
+
+struct peprate_bucket *peprate_get(uint32_t addr, uint64_t rate, uint64_t burst);
+void peprate_put(struct peprate_bucket *bucket);
+size_t peprate_take(struct peprate_bucket *bucket, size_t want, uint64_t now,
+				int queued, uint64_t *wait);
+void peprate_refund(struct peprate_bucket *bucket, size_t bytes);
+int peprate_pacing(int fd, uint64_t rate);
+void peprate_dump_json(FILE *file);
+
+#endif /* __PEPRATE_H */
@@ -0,0 +1,83 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPREC_H
+#define __PEPREC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pepdefs.h"
+#include "pepsal.h"
+#include "pepstat.h"
+
+/*
+ * Flight recorder: every thread keeps the last PEPREC_RING_SIZE
+ * lifecycle and I/O events in its own ring. Recording an event is a
+ * clock read and a few stores, the rings are only read when they are
+ * dumped (on signal, control command or fatal error).
+ */
+
+/* Events per thread, must be a power of two */
+#define PEPREC_RING_SIZE 4096
+
+enum peprec_type {
+		PEPREC_NONE = 0,
+		PEPREC_ACCEPT,       /* arg: client fd */
+		PEPREC_SYNTAB_ADD,   /* arg: SYN table entries */
+		PEPREC_SYNTAB_DEL,   /* arg: SYN table entries */
+		PEPREC_CONNECT,      /* connect() issued, arg: server fd */
+		PEPREC_CONNECTED,    /* SO_ERROR checked, err: SO_ERROR */
+		PEPREC_RECV,         /* arg: bytes read, 0 on EOF */
+		PEPREC_SEND,         /* arg: bytes written */
+		PEPREC_IOERR,        /* arg: fd */
+		PEPREC_EXPIRED,      /* pending proxy removed by the collector */
+		PEPREC_DESTROY,      /* arg: bytes relayed */
+		PEPREC_NR,
+};
+
+struct peprec_event {
+		uint64_t ts;
+		uint32_t src_addr;
+		uint32_t dst_addr;
+		uint16_t src_port;
+		uint16_t dst_port;
+		uint8_t type;
+		uint8_t status;
+		int16_t err;
+		int32_t arg;
+};
+
+struct peprec_ring {
+		uint32_t pos;
+		struct peprec_event events[PEPREC_RING_SIZE];
+};
+
+extern struct peprec_ring peprec_rings[PEPSTAT_MAX_THREADS];
+
+static __inline void peprec_event(enum peprec_type type,
+				struct pep_proxy *proxy, int err, int64_t arg)
+{
+		struct peprec_ring *ring = &peprec_rings[pepstat_self - pepstat_threads];
+		struct peprec_event *ev;
+
+		ev = &ring->events[ring->pos++ & (PEPREC_RING_SIZE - 1)];
+		ev->ts = pep_clock_ns();
+		ev->src_addr = proxy->src.addr;
+		ev->src_port = proxy->src.port;
+		ev->dst_addr = proxy->dst.addr;
+		ev->dst_port = proxy->dst.port;
+		ev->type = type;
+		ev->status = proxy->status;
+		ev->err = err;
+		ev->arg = (arg > INT32_MAX) ? INT32_MAX : arg;
+}
+
+int peprec_dump(FILE *file, const char *reason);
+
+#endif /* __PEPREC_H */
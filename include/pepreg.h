@@ -0,0 +1,57 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPREG_H
+#define __PEPREG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "pepdefs.h"
+
+/*
+ * Registry of objects shared by the connections with the same key,
+ * such as the rate buckets of a client (peprate.h) or the scheduling
+ * groups of a prefix (pepdrr.h). Objects start with a struct
+ * pepreg_entry, are created by the first connection that looks their
+ * key up and are unlinked with the last reference.
+ *
+ * The registry lock covers the chains and the reference counts. It's
+ * taken when a connection starts or ends and to walk the registry,
+ * never on the data path.
+ */
+
+#define PEPREG_HASH_SZ 256
+
+struct pepreg_entry {
+		uint64_t key;
+		int refcnt;
+		struct pepreg_entry *next;
+};
+
+struct pepreg {
+		pthread_mutex_t lock;
+		struct pepreg_entry *table[PEPREG_HASH_SZ];
+};
+
+#define PEPREG_INITIALIZER { PTHREAD_MUTEX_INITIALIZER, { NULL } }
+
+/*
+ * Called under the registry lock by pepreg_get(), with @created set
+ * if @entry was just allocated (zeroed, key set), and by
+ * pepreg_foreach().
+ */
+typedef void (*pepreg_fn_t)(struct pepreg_entry *entry, int created, void *arg);
+
+struct pepreg_entry *pepreg_get(struct pepreg *reg, uint64_t key, size_t size,
+				pepreg_fn_t setup, void *arg);
+int pepreg_put(struct pepreg *reg, struct pepreg_entry *entry);
+void pepreg_foreach(struct pepreg *reg, pepreg_fn_t fn, void *arg);
+
+#endif /* __PEPREG_H */
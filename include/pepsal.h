@@ -13,6 +13,7 @@
 #ifndef __PEPSAL_H
 #define __PEPSAL_H
 
+#include <stdint.h>
 #include "pepdefs.h"
 #include "pepbuf.h"
 #include "atomic.h"
@@ -33,6 +34,29 @@ enum proxy_status {
 #define PEP_IOERR   0x08
 
 struct pep_proxy;
+struct pep_policy;
+struct pep_config;
+
+/*
+ * Per-endpoint I/O counters. "in" is what was read from the
+ * endpoint's socket, "out" is what was written to it. An endpoint
+ * is only ever touched by one thread at a time (the worker owning
+ * its proxy), so the counters are updated without atomics.
+ * logged_* fields are snapshots written only by the logger, they
+ * are used to compute per-interval throughput.
+ */
+struct pep_endpoint_stats {
+		uint64_t bytes_in;
+		uint64_t bytes_out;
+		uint64_t reads;
+		uint64_t writes;
+		uint64_t read_eagain;
+		uint64_t write_eagain;
+		uint64_t buf_full;
+		size_t buf_peak;
+		uint64_t logged_bytes_in;
+		uint64_t logged_bytes_out;
+};
 
 struct pep_endpoint{
 		int addr;
@@ -42,10 +66,31 @@ struct pep_endpoint{
 		struct pep_proxy *owner;
 		unsigned short poll_events;
 		unsigned char iostat;
+		unsigned char throttled;    /* not read from, see pepmem.h */
+		unsigned char shrunk;       /* socket buffers shrunk, see peppressure.h */
+		int sockbuf_saved[2];       /* SO_SNDBUF/SO_RCVBUF before shrinking */
+		unsigned char relay_shrunk; /* relay buffer shrunk, ditto */
+		size_t queued;              /* kernel send queue, last sample */
+		uint64_t paced_until;       /* not written to before, see peprate.h */
+		struct pep_endpoint_stats stats;
 };
 
 #define PROXY_ENDPOINTS 2
 
+/*
+ * Connection setup timeline. Every event is stamped once with
+ * the monotonic clock (in ns) when the proxy goes through it.
+ */
+enum pep_timeline_event {
+		PEP_TL_ACCEPT = 0,   /* accept() in listener_loop */
+		PEP_TL_CONNECT,      /* connect() to the server issued */
+		PEP_TL_ESTABLISHED,  /* SO_ERROR success in poller_loop */
+		PEP_TL_CLIENT_DATA,  /* first byte received from the client */
+		PEP_TL_SERVER_SENT,  /* first byte sent to the server */
+		PEP_TL_SERVER_DATA,  /* first byte received from the server */
+		PEP_TL_NR,
+};
+
 struct pep_proxy {
 		enum proxy_status status;
 		struct list_node lnode;
@@ -61,8 +106,18 @@ struct pep_proxy {
 
 		time_t syn_time;
 		time_t last_rxtx;
+		uint64_t timeline[PEP_TL_NR];
+		uint64_t ready_ts;  /* when poll() reported I/O readiness */
 		atomic_t refcnt;
 		int enqueued;
+		struct pep_config *config;  /* configuration it was accepted with */
+		struct pep_policy *policy;  /* NULL: configuration defaults only */
+		int sockbuf;                /* egress buffer size set, 0 if none */
+		struct peprate_bucket *terminal;  /* NULL: no terminal rate */
+		struct pepdrr_group *drr_group;   /* NULL: not scheduled, see pepdrr.h */
+		size_t drr_left;            /* bytes it may still write this round */
+		size_t drr_used;            /* bytes written this round */
+		int drr_limited;            /* stopped by its share this round */
 };
 
 #endif /* !__PEPSAL_H */
@@ -0,0 +1,79 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPSHM_H
+#define __PEPSHM_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the statistics segment published in /dev/shm.
+ * This header is shared with external readers: any layout change
+ * must bump PEPSHM_VERSION. Arrays have fixed sizes so that adding
+ * counters to pepsal doesn't change the layout, readers must only
+ * look at the first nr_counters entries and at thread slots that
+ * have a name.
+ *
+ * The segment is protected by a seqlock: the writer makes seq odd
+ * while it updates the segment and even once it's done. A reader
+ * copies the segment and retries if seq was odd or changed meanwhile.
+ */
+
+#define PEPSHM_MAGIC   0x50455053 /* "PEPS" */
+#define PEPSHM_VERSION 1
+
+#define PEPSHM_DEFAULT_NAME "/pepsal-stats"
+#define PEPSHM_INTERVAL_MS  100
+
+#define PEPSHM_MAX_COUNTERS 64
+#define PEPSHM_MAX_THREADS  32
+#define PEPSHM_NAME_SZ      32
+
+struct pepshm_gauges {
+		uint32_t live_proxies;
+		uint32_t max_conns;
+		uint32_t active_queue;
+		uint32_t ready_queue;
+		uint32_t workers;
+		uint32_t reserved[11];
+};
+
+struct pepshm_thread {
+		char name[16];
+		uint64_t counters[PEPSHM_MAX_COUNTERS];
+};
+
+struct pepshm_segment {
+		/* Constant part, written once at creation */
+		uint32_t magic;
+		uint32_t version;
+		uint32_t size;
+		uint32_t pid;
+		uint32_t nr_counters;
+		uint32_t interval_ms;
+		uint64_t start_time;
+		char counter_names[PEPSHM_MAX_COUNTERS][PEPSHM_NAME_SZ];
+
+		/* Protected by seq */
+		uint32_t seq;
+		uint32_t nr_threads;
+		uint64_t update_ns; /* CLOCK_MONOTONIC time of the last update */
+		uint64_t updates;
+		struct pepshm_gauges gauges;
+		uint64_t totals[PEPSHM_MAX_COUNTERS];
+		struct pepshm_thread threads[PEPSHM_MAX_THREADS];
+};
+
+/* Writer side, see pepshm.c */
+typedef void (*pepshm_gauges_fn)(struct pepshm_gauges *gauges);
+
+int pepshm_init(const char *name, pepshm_gauges_fn gauges_fn);
+void *pepshm_loop(void *unused);
+
+#endif /* __PEPSHM_H */
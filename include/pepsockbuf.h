@@ -0,0 +1,52 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPSOCKBUF_H
+#define __PEPSOCKBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pepdefs.h"
+
+/*
+ * Socket buffer sizing of the server side (egress) sockets. Without
+ * it, the kernel autotunes buffers up to the global tcp_wmem/tcp_rmem
+ * maximums: too little for the bandwidth-delay product of a satellite
+ * path, more than terrestrial flows need. When a link profile (rate
+ * and RTT) applies to a connection, SO_SNDBUF and SO_RCVBUF of its
+ * egress socket are set to the BDP before connecting; with measured
+ * sizing they are then adjusted to twice the measured BDP (delivery
+ * rate times RTT), leaving room for the rate to grow.
+ *
+ * Sizes are kept within per-socket limits, and the sum over all
+ * sockets within a budget; growing a buffer must also fit in the
+ * global memory budget (pepmem.h). Sizes are counted as requested, the
+ * kernel doubles them for its bookkeeping overhead.
+ */
+
+#define PEPSOCKBUF_MIN     (64 * 1024)
+#define PEPSOCKBUF_MAX     (32 * 1024 * 1024)
+
+/* Connections looked at per measured sizing pass (one per second) */
+#define PEPSOCKBUF_BATCH   512
+
+struct pepsockbuf_limits {
+		size_t min;
+		size_t max;
+		size_t budget;      /* 0: no budget */
+};
+
+size_t pepsockbuf_bdp(uint64_t rate, uint64_t rtt_us);
+int pepsockbuf_set(int fd, int cur, size_t want,
+				const struct pepsockbuf_limits *lim, size_t mem_budget);
+void pepsockbuf_release(int size);
+int pepsockbuf_shrink(int fd, int size, int saved[2]);
+void pepsockbuf_restore(int fd, const int saved[2]);
+
+#endif /* __PEPSOCKBUF_H */
@@ -0,0 +1,144 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPSTAT_H
+#define __PEPSTAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "pepdefs.h"
+
+/* Maximal number of threads that may own a statistics slot */
+#define PEPSTAT_MAX_THREADS 32
+
+/*
+ * Histograms are log-bucketed in the HDR fashion: values are grouped
+ * by power of two and each power of two is split into
+ * 2^PEPHIST_SUB_BITS linear sub-buckets, so the relative error of any
+ * reported value is bounded by 1/2^PEPHIST_SUB_BITS. Values are
+ * nanoseconds, anything above 2^PEPHIST_MAX_BITS ns (~68 seconds)
+ * goes to the last bucket.
+ */
+#define PEPHIST_SUB_BITS 3
+#define PEPHIST_SUB      (1 << PEPHIST_SUB_BITS)
+#define PEPHIST_MAX_BITS 36
+#define PEPHIST_BUCKETS                                           \
+		((PEPHIST_MAX_BITS - PEPHIST_SUB_BITS + 1) * PEPHIST_SUB + PEPHIST_SUB)
+
+enum pephist_id {
+		PEPHIST_POLL_DISPATCH = 0,
+		PEPHIST_WORKER_SERVICE,
+		PEPHIST_READY_TURNAROUND,
+		PEPHIST_ACCEPT_CONNECT,
+		/* Connection setup phases, see enum pep_timeline_event */
+		PEPHIST_SETUP_CONNECT,
+		PEPHIST_SETUP_HANDSHAKE,
+		PEPHIST_SETUP_CLIENT_DATA,
+		PEPHIST_SETUP_FORWARD,
+		PEPHIST_SETUP_RESPONSE,
+		PEPHIST_SETUP_TTFB,
+		PEPHIST_STALL,
+		PEPHIST_NR,
+};
+
+enum pepstat_counter {
+		PEPSTAT_ACCEPTED = 0,
+		PEPSTAT_ACCEPT_ERRORS,
+		PEPSTAT_DUP_SYNS,
+		PEPSTAT_CONNECTS,
+		PEPSTAT_CONNECT_ERRORS,
+		PEPSTAT_ESTABLISHED,
+		PEPSTAT_DESTROYED,
+		PEPSTAT_IO_ERRORS,
+		PEPSTAT_BYTES_FROM_CLIENTS,
+		PEPSTAT_BYTES_FROM_SERVERS,
+		PEPSTAT_DEBUG_DROPPED,
+		PEPSTAT_STALLS,
+		PEPSTAT_SOCKBUF_RESIZES,
+		PEPSTAT_SOCKBUF_CAPPED,
+		PEPSTAT_THROTTLED,
+		PEPSTAT_RELAY_CAPPED,
+		PEPSTAT_PRESSURE_SHRINKS,
+		PEPSTAT_PRESSURE_RESTORES,
+		PEPSTAT_PACED,
+		PEPSTAT_NR,
+};
+
+/*
+ * Statistics of one thread. Only the owner thread writes into its
+ * slot, readers merge all slots without any locking.
+ */
+struct pepstat_thread {
+		char name[16];
+		int used;
+		uint64_t counters[PEPSTAT_NR];
+		uint64_t hist[PEPHIST_NR][PEPHIST_BUCKETS];
+} __attribute__((aligned(64)));
+
+/* Merged view of one histogram */
+struct pephist {
+		uint64_t buckets[PEPHIST_BUCKETS];
+};
+
+extern struct pepstat_thread pepstat_threads[PEPSTAT_MAX_THREADS];
+extern __thread struct pepstat_thread *pepstat_self;
+
+/* Monotonic time in nanoseconds */
+static __inline uint64_t pep_clock_ns(void)
+{
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static __inline void pepstat_add(enum pepstat_counter id, uint64_t val)
+{
+		pepstat_self->counters[id] += val;
+}
+
+#define pepstat_inc(id) pepstat_add(id, 1)
+
+static __inline int pephist_bucket(uint64_t val)
+{
+		int shift;
+
+		if (val < PEPHIST_SUB) {
+				return (int)val;
+		}
+
+		shift = 63 - __builtin_clzll(val) - PEPHIST_SUB_BITS;
+		if (shift > PEPHIST_MAX_BITS - PEPHIST_SUB_BITS) {
+				return PEPHIST_BUCKETS - 1;
+		}
+
+		return shift * PEPHIST_SUB + (int)(val >> shift);
+}
+
+static __inline void pephist_record(enum pephist_id id, uint64_t val)
+{
+		pepstat_self->hist[id][pephist_bucket(val)]++;
+}
+
+/* Record time elapsed since @start (as returned by pep_clock_ns) */
+static __inline void pephist_record_since(enum pephist_id id, uint64_t start)
+{
+		pephist_record(id, pep_clock_ns() - start);
+}
+
+int pepstat_thread_init(const char *name);
+const char *pepstat_name(enum pepstat_counter id);
+uint64_t pepstat_read(enum pepstat_counter id);
+void pepstat_dump_json(FILE *file);
+void pephist_merge(enum pephist_id id, struct pephist *hist);
+void pephist_print_json(FILE *file, struct pephist *hist, struct pephist *prev);
+void pephist_dump_json(FILE *file, struct pephist *prev);
+
+#endif /* __PEPSTAT_H */
@@ -0,0 +1,43 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPTRACE_H
+#define __PEPTRACE_H
+
+#include "config.h"
+
+/*
+ * Statically defined user-space tracepoints of the "pepsal" provider.
+ * A disabled probe costs a single nop, they may be attached at runtime
+ * with bpftrace or perf, e.g.:
+ *
+ *     bpftrace -e 'usdt:/usr/bin/pepsal:pepsal:receive { @[arg3] = count(); }'
+ *
+ * Unless stated otherwise, the first two arguments of a probe are the
+ * client address and port in host byte order.
+ * See pepsal(1) for the list of probes.
+ */
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+#define PEP_TRACE1(name, a)                 DTRACE_PROBE1(pepsal, name, a)
+#define PEP_TRACE2(name, a, b)              DTRACE_PROBE2(pepsal, name, a, b)
+#define PEP_TRACE3(name, a, b, c)           DTRACE_PROBE3(pepsal, name, a, b, c)
+#define PEP_TRACE4(name, a, b, c, d)        DTRACE_PROBE4(pepsal, name, a, b, c, d)
+#define PEP_TRACE5(name, a, b, c, d, e)     DTRACE_PROBE5(pepsal, name, a, b, c, d, e)
+#else /* !ENABLE_USDT */
+#define PEP_TRACE1(name, a)                 do {} while (0)
+#define PEP_TRACE2(name, a, b)              do {} while (0)
+#define PEP_TRACE3(name, a, b, c)           do {} while (0)
+#define PEP_TRACE4(name, a, b, c, d)        do {} while (0)
+#define PEP_TRACE5(name, a, b, c, d, e)     do {} while (0)
+#endif /* ENABLE_USDT */
+
+#endif /* __PEPTRACE_H */
@@ -0,0 +1,117 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#ifndef __PEPWATCH_H
+#define __PEPWATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pepdefs.h"
+#include "pepsal.h"
+#include "pepstat.h"
+
+/*
+ * Stall detector. The poller and the workers mark the beginning of
+ * each loop iteration and the call they are in; the iteration ends
+ * when they go back to block in poll() or on their queue.
+ * An iteration longer than the threshold is a stall: the thread
+ * itself counts it (PEPSTAT_STALLS, PEPHIST_STALL) when it ends, and
+ * the watchdog thread, which samples all threads, records the call
+ * and proxy that were running at the time among the recent offenders.
+ */
+
+/* Number of remembered offenders */
+#define PEPWATCH_RECENT 16
+
+struct pepwatch_slot {
+		uint64_t iter_start;    /* 0 when the thread is idle */
+		const char *call;
+		uint32_t addr;
+		uint16_t port;
+} __attribute__((aligned(64)));
+
+struct pepwatch_offender {
+		uint64_t seq;
+		time_t time;
+		char thread[16];
+		const char *call;
+		uint32_t addr;
+		uint16_t port;
+		uint64_t running_ns;
+};
+
+extern uint64_t pepwatch_threshold_ns;
+extern struct pepwatch_slot pepwatch_slots[PEPSTAT_MAX_THREADS];
+
+static __inline struct pepwatch_slot *pepwatch_self(void)
+{
+		return &pepwatch_slots[pepstat_self - pepstat_threads];
+}
+
+/*
+ * Tell the watchdog that the calling thread is in @call, working on
+ * @proxy (may be NULL).
+ */
+static __inline void pepwatch_call(const char *call, struct pep_proxy *proxy)
+{
+		struct pepwatch_slot *slot;
+
+		if (!pepwatch_threshold_ns) {
+				return;
+		}
+
+		slot = pepwatch_self();
+		__atomic_store_n(&slot->call, call, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->addr, proxy ? proxy->src.addr : 0,
+						__ATOMIC_RELAXED);
+		__atomic_store_n(&slot->port, proxy ? proxy->src.port : 0,
+						__ATOMIC_RELAXED);
+}
+
+/* Start of an iteration, the thread got some work */
+static __inline void pepwatch_begin(const char *call)
+{
+		if (!pepwatch_threshold_ns) {
+				return;
+		}
+
+		pepwatch_call(call, NULL);
+		if (!pepwatch_self()->iter_start) {
+				__atomic_store_n(&pepwatch_self()->iter_start, pep_clock_ns(),
+								__ATOMIC_RELEASE);
+		}
+}
+
+/* End of an iteration, the thread is about to block waiting for work */
+static __inline void pepwatch_idle(void)
+{
+		struct pepwatch_slot *slot;
+		uint64_t elapsed;
+
+		if (!pepwatch_threshold_ns) {
+				return;
+		}
+
+		slot = pepwatch_self();
+		if (!slot->iter_start) {
+				return;
+		}
+
+		elapsed = pep_clock_ns() - slot->iter_start;
+		if (elapsed > pepwatch_threshold_ns) {
+				pepstat_inc(PEPSTAT_STALLS);
+				pephist_record(PEPHIST_STALL, elapsed);
+		}
+		__atomic_store_n(&slot->iter_start, 0, __ATOMIC_RELEASE);
+}
+
+void pepwatch_dump_json(FILE *file, uint64_t *last_seq);
+void *pepwatch_loop(void *unused);
+
+#endif /* __PEPWATCH_H */
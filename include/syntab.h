@@ -16,6 +16,7 @@
 #include <pthread.h>
 #include "hashtable.h"
 #include "list.h"
+#include "peplock.h"
 #include "pepsal.h"
 
 struct syn_table{
@@ -25,6 +26,14 @@ struct syn_table{
 		int                num_items;
 };
 
+struct syntab_stats {
+		unsigned int entries;
+		unsigned int buckets;
+		unsigned int used_buckets;
+		unsigned int longest_chain;
+		double load_factor;
+};
+
 struct syntab_key {
 		int addr;
 		unsigned short port;
@@ -32,10 +41,14 @@ struct syntab_key {
 
 #define GET_SYNTAB() (&syntab)
 
-#define SYNTAB_LOCK_READ()    pthread_rwlock_rdlock(&(GET_SYNTAB())->lock)
-#define SYNTAB_LOCK_WRITE()   pthread_rwlock_wrlock(&(GET_SYNTAB())->lock)
-#define SYNTAB_UNLOCK_READ()  pthread_rwlock_unlock(&(GET_SYNTAB())->lock)
-#define SYNTAB_UNLOCK_WRITE() pthread_rwlock_unlock(&(GET_SYNTAB())->lock)
+#define SYNTAB_LOCK_READ()                                              \
+		peplock_rdlock(&(GET_SYNTAB())->lock, PEPLOCK_SYNTAB_READ)
+#define SYNTAB_LOCK_WRITE()                                             \
+		peplock_wrlock(&(GET_SYNTAB())->lock, PEPLOCK_SYNTAB_WRITE)
+#define SYNTAB_UNLOCK_READ()                                            \
+		peplock_rwunlock(&(GET_SYNTAB())->lock, PEPLOCK_SYNTAB_READ)
+#define SYNTAB_UNLOCK_WRITE()                                           \
+		peplock_rwunlock(&(GET_SYNTAB())->lock, PEPLOCK_SYNTAB_WRITE)
 
 extern struct syn_table syntab;
 
@@ -47,5 +60,6 @@ void syntab_format_key(struct pep_proxy *proxy, struct syntab_key *key);
 struct pep_proxy *syntab_find(struct syntab_key *key);
 int syntab_add(struct pep_proxy *proxy);
 void syntab_delete(struct pep_proxy *proxy);
+void syntab_get_stats(struct syntab_stats *stats);
 
 #endif /* __PEPSAL_SYNTAB_H */
@@ -135,6 +135,24 @@ hashtable_count(struct hashtable *h)
 		return h->entrycount;
 }
 
+/*****************************************************************************/
+		unsigned int
+hashtable_chain_stats(struct hashtable *h, unsigned int *used,
+				unsigned int *longest)
+{
+		unsigned int i, len;
+		struct entry *e;
+		*used = *longest = 0;
+		for (i = 0; i < h->tablelength; i++)
+		{
+				len = 0;
+				for (e = h->table[i]; NULL != e; e = e->next) len++;
+				if (len) (*used)++;
+				if (len > *longest) *longest = len;
+		}
+		return h->tablelength;
+}
+
 /*****************************************************************************/
 		int
 hashtable_insert(struct hashtable *h, void *k, void *v)
@@ -13,6 +13,22 @@
 #include "config.h"
 #include "pepsal.h"
 #include "pepqueue.h"
+#include "pepctl.h"
+#include "peplock.h"
+#include "peplog.h"
+#include "pepconfig.h"
+#include "pepmem.h"
+#include "pepperf.h"
+#include "peppolicy.h"
+#include "peppressure.h"
+#include "peprate.h"
+#include "pepdrr.h"
+#include "peprec.h"
+#include "pepshm.h"
+#include "pepsockbuf.h"
+#include "pepstat.h"
+#include "peptrace.h"
+#include "pepwatch.h"
 #include "syntab.h"
 
 #include <unistd.h>
@@ -42,11 +58,14 @@
 #include <net/if.h>
 
 #include <sys/poll.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 #include <string.h>
 #include <time.h>
 #include <signal.h>
 #include <syslog.h>
 #include <ctype.h>
+#include <inttypes.h>
 
 #include <sys/time.h>
 
@@ -75,15 +94,58 @@ struct ipv4_packet{
 static int DEBUG = 0;
 static int background = 0;
 static int fastopen = 0;
-static int gcc_interval = PEP_GCC_INTERVAL;
-static int pending_conn_lifetime = PEP_PENDING_CONN_LIFETIME;
 static int portnum = PEP_DEFAULT_PORT;
-static int ingress_mtu = 0;
-static unsigned int mark_egress = 0;
-static unsigned int mark_ingress = 0;
-static int max_conns = (PEP_MIN_CONNS + PEP_MAX_CONNS) / 2;
-static char tcp_congestion_algo_egress[32] = "";
-static char tcp_congestion_algo_ingress[32] = "";
+static int max_conns = PEP_DEFAULT_CONNS;
+
+/*
+ * Reloadable tunables as set on the command line. Every reload starts
+ * from a copy of these, see pepconfig.h.
+ */
+static struct pep_config cmdline_config = {
+		.gcc_interval = PEP_GCC_INTERVAL,
+		.pending_conn_lifetime = PEP_PENDING_CONN_LIFETIME,
+		.log_interval = PEPLOGGER_INTERVAL,
+		.sockbuf = {
+				.min = PEPSOCKBUF_MIN,
+				.max = PEPSOCKBUF_MAX,
+		},
+		.pressure = 1,
+		.drr_prefix = 32,
+};
+static char *config_path = NULL;
+static pthread_mutex_t reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t reload_requested = 0;
+static int throttled_endpoints = 0;
+
+/*
+ * Memory pressure state, see peppressure.h. The timer samples the
+ * pressure and shrinks socket buffers, the poller shrinks relay
+ * buffers when the timer asks it to: between two batches no worker
+ * touches them. Only the timer writes them: @pressure is the last
+ * complete sample, for the dumps, under @pressure_lock; @pressure_level
+ * its level, read by the poller without the lock.
+ */
+static struct peppressure_sample pressure;
+static pthread_mutex_t pressure_lock = PTHREAD_MUTEX_INITIALIZER;
+static int pressure_level = PEPPRESSURE_NONE;
+static volatile sig_atomic_t relay_check_requested = 0;
+static int shrunk_sockets = 0;
+static int shrunk_relays = 0;
+
+/*
+ * Static destination (-D) used instead of the original destination of
+ * intercepted connections, in host byte order. Mostly for benchmarks:
+ * no TPROXY rules nor IP_TRANSPARENT are needed then.
+ */
+static int static_dst = 0;
+static int static_dst_addr;
+static unsigned short static_dst_port;
+static char *ctl_path = NULL;
+static char *shm_name = NULL;
+static char *flightrec_path = NULL;
+static char *policy_path = NULL;
+static volatile sig_atomic_t flightrec_requested = 0;
+static time_t start_time;
 
 /*
  * The main aim of this structure is to reduce search time
@@ -111,6 +173,7 @@ struct pep_logger {
 		FILE *file;
 		timer_t timer;
 		char *filename;
+		time_t last_dump;
 };
 
 /*
@@ -125,9 +188,19 @@ struct pep_logger {
 static struct pep_queue active_queue, ready_queue;
 static struct pep_logger logger;
 
+/* Histogram values at the previous logger dump */
+static struct pephist logger_hist[PEPHIST_NR];
+static struct peplock_totals logger_locks[PEPLOCK_NR];
+static uint64_t logger_stall_seq = 0;
+static struct pepperf_totals logger_perf;
+
 static pthread_t listener;
 static pthread_t poller;
 static pthread_t timer_sch;
+static pthread_t ctl;
+static pthread_t shm;
+static pthread_t debug_logger;
+static pthread_t watchdog;
 static pthread_t *workers = NULL;
 
 #define pep_error(fmt, args...)                       \
@@ -140,24 +213,23 @@ __pep_error(__FUNCTION__, __LINE__, fmt, ##args)
 						__FUNCTION__, __LINE__, ##args);           \
 __pep_warning(__FUNCTION__, __LINE__, fmt, ##args)
 
+/*
+ * Debug messages are queued into the calling thread's ring and
+ * written to stderr and syslog by the debug_logger thread.
+ */
 #define PEP_DEBUG(fmt, args...)                       \
 		if (DEBUG) {                                      \
-				fprintf(stderr, "[DEBUG] %s(): " fmt "\n",    \
-								__FUNCTION__, ##args);                \
-				syslog(LOG_DEBUG, "%s(): " fmt, __FUNCTION__, \
-##args);                                \
+				peplog_debug(__FUNCTION__, fmt, ##args);      \
 		}
 
 #define PEP_DEBUG_DP(proxy, fmt, args...)                           \
 		if (DEBUG) {                                                    \
-				char __buf[17];                                             \
-				toip(__buf, (proxy)->src.addr);                             \
-				fprintf(stderr, "[DEBUG] %s(): {%s:%d} " fmt "\n",          \
-								__FUNCTION__, __buf, (proxy)->src.port, ##args);    \
-				syslog(LOG_DEBUG, "%s(): {%s:%d} " fmt, __FUNCTION__,       \
-								__buf, (proxy)->src.port, ##args);                   \
+				peplog_debug_dp(__FUNCTION__, (proxy)->src.addr,            \
+								(proxy)->src.port, fmt, ##args);                    \
 		}
 
+static int flightrec_dump(const char *reason);
+
 				static void __pep_error(const char *function, int line, const char *fmt, ...)
 {
 		va_list ap;
@@ -174,6 +246,11 @@ __pep_warning(__FUNCTION__, __LINE__, fmt, ##args)
 								"\n      ERRNO: [%s:%d]", strerror(err), err);
 		}
 
+		if (DEBUG) {
+				peplog_flush();
+		}
+
+		flightrec_dump("fatal error");
 		fprintf(stderr, "%s\n         AT: %s:%d\n", buf, function, line);
 		va_end(ap);
 		closelog();
@@ -203,7 +280,12 @@ static void usage(char *name)
 						" [-a egress tcp congestion algorithm] [-b ingress tcp congestion algorithm]"
 						" [-u mtu of ingress device]"
 						" [-p port] [-c max_conn] [-l logfile] [-t proxy_lifetime]"
-						" [-g garbage collector interval]\n", name);
+						" [-g garbage collector interval]"
+						" [-s control socket] [-S shm stats name]"
+						" [-r flight recorder dump file] [-L] [-P]"
+						" [-w stall threshold ms] [-D static destination ip:port]"
+						" [-x policy file] [-F config file]\n",
+						name);
 		exit(EXIT_SUCCESS);
 }
 
@@ -252,13 +334,197 @@ static char *conn_stat[] = {
 		"PST_PENDING",
 };
 
+/*
+ * Setup phases, i.e. the time between an event of the timeline and
+ * the previous one. The phase of PEP_TL_ACCEPT is meaningless.
+ */
+static const struct {
+		const char *name;
+		enum pephist_id hist;
+} timeline_phases[PEP_TL_NR] = {
+		[PEP_TL_CONNECT]     = { "connect",     PEPHIST_SETUP_CONNECT },
+		[PEP_TL_ESTABLISHED] = { "handshake",   PEPHIST_SETUP_HANDSHAKE },
+		[PEP_TL_CLIENT_DATA] = { "client_data", PEPHIST_SETUP_CLIENT_DATA },
+		[PEP_TL_SERVER_SENT] = { "forward",     PEPHIST_SETUP_FORWARD },
+		[PEP_TL_SERVER_DATA] = { "response",    PEPHIST_SETUP_RESPONSE },
+};
+
+/*
+ * Stamp event @ev of the proxy setup timeline and account the phase
+ * that ends with it. Only the first occurence of an event is taken
+ * into account. A phase is skipped if its starting event didn't
+ * happen, e.g. if the server sent data before the client did.
+ */
+static void timeline_mark(struct pep_proxy *proxy, enum pep_timeline_event ev)
+{
+		uint64_t now, prev;
+
+		if (proxy->timeline[ev]) {
+				return;
+		}
+
+		now = pep_clock_ns();
+		proxy->timeline[ev] = now;
+		if (ev == PEP_TL_ACCEPT) {
+				return;
+		}
+
+		prev = proxy->timeline[ev - 1];
+		if (prev) {
+				pephist_record(timeline_phases[ev].hist, now - prev);
+		}
+		if (ev == PEP_TL_SERVER_DATA) {
+				pephist_record(PEPHIST_SETUP_TTFB, now - proxy->timeline[PEP_TL_ACCEPT]);
+		}
+}
+
+/*
+ * Dump per-phase setup breakdown of @proxy.
+ * Must be called with the SYN table locked.
+ */
+static void dump_timeline(FILE *file, struct pep_proxy *proxy)
+{
+		int ev, i = 0;
+
+		if (!proxy->timeline[PEP_TL_ACCEPT]) {
+				return;
+		}
+
+		fprintf(file, ",\"setup_ns\":{");
+		for (ev = PEP_TL_CONNECT; ev < PEP_TL_NR; ev++) {
+				if (!proxy->timeline[ev] || !proxy->timeline[ev - 1]) {
+						continue;
+				}
+
+				fprintf(file, "%s\"%s\":%" PRIu64, i++ ? "," : "",
+								timeline_phases[ev].name,
+								proxy->timeline[ev] - proxy->timeline[ev - 1]);
+		}
+		if (proxy->timeline[PEP_TL_SERVER_DATA]) {
+				fprintf(file, "%s\"ttfb\":%" PRIu64, i ? "," : "",
+								proxy->timeline[PEP_TL_SERVER_DATA] -
+								proxy->timeline[PEP_TL_ACCEPT]);
+		}
+		fprintf(file, "}");
+}
+
+/*
+ * Dump I/O counters of the endpoint @endp as a JSON object named @name.
+ * Rates are the number of bytes transfered since @base_in/@base_out
+ * divided by @interval.
+ * Must be called with the SYN table locked.
+ */
+static void dump_endpoint_stats(FILE *file, const char *name,
+				struct pep_endpoint *endp, uint64_t base_in, uint64_t base_out,
+				double interval)
+{
+		struct pep_endpoint_stats *st = &endp->stats;
+		double rate_in = 0, rate_out = 0;
+
+		if (interval > 0) {
+				rate_in = (st->bytes_in - base_in) / interval;
+				rate_out = (st->bytes_out - base_out) / interval;
+		}
+
+		fprintf(file, ",\"%s\":{\"bytes_in\":%" PRIu64
+						",\"bytes_out\":%" PRIu64 ",\"rate_in\":%.f,\"rate_out\":%.f"
+						",\"reads\":%" PRIu64 ",\"writes\":%" PRIu64
+						",\"read_eagain\":%" PRIu64 ",\"write_eagain\":%" PRIu64
+						",\"buf_full\":%" PRIu64 ",\"buf_used\":%zu,\"buf_peak\":%zu}",
+						name, st->bytes_in, st->bytes_out, rate_in, rate_out,
+						st->reads, st->writes, st->read_eagain, st->write_eagain,
+						st->buf_full, PEPBUF_SPACE_FILLED(&endp->buf), st->buf_peak);
+}
+
+/*
+ * Dump @proxy as a JSON object. If @logged is set, rates are computed
+ * over the logger interval (or over the proxy lifetime if it appeared
+ * after the previous dump) and the logger snapshots are updated.
+ * Otherwise rates are averaged over the whole proxy lifetime.
+ * Must be called with the SYN table locked.
+ */
+static void dump_proxy(FILE *file, struct pep_proxy *proxy, time_t tm,
+				int logged)
+{
+		char ip_src[17], ip_dst[17];
+		int tcp_info_length, curr_mss, curr_mss_len, i;
+		struct tcp_info tcp_info;
+		struct pep_endpoint_stats *st;
+		double interval;
+
+		toip(ip_src, proxy->src.addr);
+		toip(ip_dst, proxy->dst.addr);
+		fprintf(file, "{\"src\":\"%s:%d\",\"dst\":\"%s:%d\",",
+						ip_src, proxy->src.port, ip_dst, proxy->dst.port);
+
+		fprintf(file, "\"status\":\"%s\",", conn_stat[proxy->status]);
+		if (proxy->policy) {
+				fprintf(file, "\"policy\":\"%s\",", proxy->policy->name);
+		}
+		if (proxy->sockbuf) {
+				fprintf(file, "\"sockbuf\":%d,", proxy->sockbuf);
+		}
+
+		fprintf(file, "\"sync_recv\":%.f", difftime(proxy->syn_time, (time_t) 0));
+
+		if (proxy->last_rxtx != 0) {
+				fprintf(file, ",\"last_rxtx\":%.f", difftime(proxy->last_rxtx, (time_t) 0));
+		}
+
+		interval = difftime(tm, proxy->syn_time);
+		if (logged && proxy->syn_time <= logger.last_dump) {
+				interval = difftime(tm, logger.last_dump);
+		}
+
+		for (i = 0; i < PROXY_ENDPOINTS; i++) {
+				st = &proxy->endpoints[i].stats;
+				dump_endpoint_stats(file, i ? "egress" : "ingress",
+								&proxy->endpoints[i],
+								logged ? st->logged_bytes_in : 0,
+								logged ? st->logged_bytes_out : 0, interval);
+				if (logged) {
+						st->logged_bytes_in = st->bytes_in;
+						st->logged_bytes_out = st->bytes_out;
+				}
+		}
+
+		dump_timeline(file, proxy);
+
+		curr_mss_len = sizeof(curr_mss);
+		if ( getsockopt(proxy->dst.fd, IPPROTO_TCP, TCP_MAXSEG, (void *)&curr_mss,
+								(socklen_t *)&curr_mss_len ) == 0 ) {
+				fprintf(file,",\"mss egress\":%d", curr_mss);
+		}
+
+		curr_mss_len = sizeof(curr_mss);
+		if ( getsockopt(proxy->src.fd, IPPROTO_TCP, TCP_MAXSEG, (void *)&curr_mss,
+								(socklen_t *)&curr_mss_len ) == 0 ) {
+				fprintf(file,",\"mss ingress\":%d", curr_mss);
+		}
+
+		tcp_info_length = sizeof(tcp_info);
+		if ( getsockopt(proxy->dst.fd, IPPROTO_TCP, TCP_INFO, (void *)&tcp_info,
+								(socklen_t *)&tcp_info_length ) == 0 ) {
+				fprintf(file,",\"rtt\":%u,", tcp_info.tcpi_rtt);
+				fprintf(file,"\"rtt_var\":%u,", tcp_info.tcpi_rttvar);
+				fprintf(file,"\"retransmits\":%u,", tcp_info.tcpi_total_retrans);
+				fprintf(file,"\"cwnd\":%u,", tcp_info.tcpi_snd_cwnd);
+				fprintf(file,"\"pacing_rate\":%u,", tcp_info.tcpi_pacing_rate);
+				fprintf(file,"\"max_pacing_rate\":%u,", tcp_info.tcpi_max_pacing_rate);
+				fprintf(file,"\"delivery_rate\":%lu", tcp_info.tcpi_delivery_rate);
+		}
+
+
+		fprintf(file, "}");
+}
+
 static void logger_fn(void)
 {
 		struct pep_proxy *proxy;
+		struct pep_config *cfg;
+		struct peppressure_sample sample;
 		time_t tm;
-		char ip_src[17], ip_dst[17];
-		int len, i = 0, tcp_info_length, curr_mss, curr_mss_len;
-		struct tcp_info tcp_info;
+		int i = 0;
 
 		PEP_DEBUG("Logger invoked!");
 		SYNTAB_LOCK_READ();
@@ -268,50 +534,197 @@ static void logger_fn(void)
 				if (i++ > 0)
 						fprintf(logger.file, ",");
 
-				toip(ip_src, proxy->src.addr);
-				toip(ip_dst, proxy->dst.addr);
-				fprintf(logger.file, "{\"src\":\"%s:%d\",\"dst\":\"%s:%d\",",
-								ip_src, proxy->src.port, ip_dst, proxy->dst.port);
+				dump_proxy(logger.file, proxy, tm, 1);
+		}
+		fprintf(logger.file, "]");
 
-				fprintf(logger.file, "\"status\":\"%s\",", conn_stat[proxy->status]);
+		SYNTAB_UNLOCK_READ();
 
-				fprintf(logger.file, "\"sync_recv\":%.f", difftime(proxy->syn_time, (time_t) 0));
+		fprintf(logger.file, ",\"latency_ns\":");
+		pephist_dump_json(logger.file, logger_hist);
+		cfg = pepconfig_get();
+		fprintf(logger.file, ",\"memory\":");
+		pepmem_dump_json(logger.file, cfg->mem_budget, throttled_endpoints);
+		pepconfig_put(cfg);
+		fprintf(logger.file, ",\"pressure\":");
+		pthread_mutex_lock(&pressure_lock);
+		sample = pressure;
+		pthread_mutex_unlock(&pressure_lock);
+		peppressure_dump_json(logger.file, &sample);
+		if (peplock_enabled) {
+				fprintf(logger.file, ",\"locks\":");
+				peplock_dump_json(logger.file, logger_locks);
+		}
+		if (pepwatch_threshold_ns) {
+				fprintf(logger.file, ",\"stalls\":");
+				pepwatch_dump_json(logger.file, &logger_stall_seq);
+		}
+		if (pepperf_enabled) {
+				fprintf(logger.file, ",\"perf\":");
+				pepperf_dump_json(logger.file, &logger_perf);
+		}
+		fprintf(logger.file, "}\n");
+		logger.last_dump = tm;
+		fflush(logger.file);
+}
 
-				if (proxy->last_rxtx != 0) {
-						fprintf(logger.file, ",\"last_rxtx\":%.f", difftime(proxy->last_rxtx, (time_t) 0));
-				}
+/*
+ * Dump the flight recorder to flightrec_path, or to stderr if no
+ * dump file was given. Returns the number of dumped events.
+ */
+static int flightrec_dump(const char *reason)
+{
+		FILE *file = stderr;
+		int ret;
 
-				curr_mss_len = sizeof(curr_mss);
-				if ( getsockopt(proxy->dst.fd, IPPROTO_TCP, TCP_MAXSEG, (void *)&curr_mss,
-										(socklen_t *)&curr_mss_len ) == 0 ) {
-						fprintf(logger.file,",\"mss egress\":%d", curr_mss);
+		if (flightrec_path) {
+				file = fopen(flightrec_path, "a");
+				if (!file) {
+						return -1;
 				}
+		}
+
+		ret = peprec_dump(file, reason);
+		if (file != stderr) {
+				fclose(file);
+		}
+
+		return ret;
+}
+
+static void flightrec_sighandler(int UNUSED(signo))
+{
+		flightrec_requested = 1;
+}
+
+static void reload_sighandler(int UNUSED(signo))
+{
+		reload_requested = 1;
+}
+
+/*
+ * Try the congestion control algorithm @cc (if set) and the mark
+ * @mark (if not 0) of @what on the scratch socket @fd.
+ */
+static int check_sockopts(int fd, const char *what, const char *cc,
+				unsigned int mark, char *err, size_t errlen)
+{
+		if (cc[0] && setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION,
+						cc, strlen(cc)) < 0) {
+				snprintf(err, errlen, "%s: tcp algorithm %s: %s", what, cc,
+								strerror(errno));
+				return -1;
+		}
+		if (mark && setsockopt(fd, SOL_SOCKET, SO_MARK, &mark, sizeof(mark)) < 0) {
+				snprintf(err, errlen, "%s: mark %u: %s", what, mark, strerror(errno));
+				return -1;
+		}
+
+		return 0;
+}
+
+/*
+ * Make sure the kernel takes the socket options of @cfg and its
+ * policies before publishing it: once published, they are applied to
+ * every accepted connection, where there is nothing left to do about
+ * a bad value but skip it.
+ */
+static int check_config(struct pep_config *cfg, char *err, size_t errlen)
+{
+		struct pep_policy *rule;
+		char what[PEPPOLICY_NAME_SZ + 32];
+		unsigned int i;
+		int fd, ret = -1;
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) {
+				snprintf(err, errlen, "socket: %s", strerror(errno));
+				return -1;
+		}
 
-				curr_mss_len = sizeof(curr_mss);
-				if ( getsockopt(proxy->src.fd, IPPROTO_TCP, TCP_MAXSEG, (void *)&curr_mss,
-										(socklen_t *)&curr_mss_len ) == 0 ) {
-						fprintf(logger.file,",\"mss ingress\":%d", curr_mss);
+		if (check_sockopts(fd, "egress", cfg->cc_egress, cfg->mark_egress,
+								err, errlen) < 0 ||
+						check_sockopts(fd, "ingress", cfg->cc_ingress, cfg->mark_ingress,
+								err, errlen) < 0) {
+				goto out;
+		}
+		for (i = 0; cfg->policies && i < cfg->policies->nr_rules; i++) {
+				rule = &cfg->policies->rules[i];
+				snprintf(what, sizeof(what), "policy line %d egress", rule->line);
+				if (check_sockopts(fd, what, rule->cc_egress, rule->mark_egress,
+										err, errlen) < 0) {
+						goto out;
 				}
+				snprintf(what, sizeof(what), "policy line %d ingress", rule->line);
+				if (check_sockopts(fd, what, rule->cc_ingress, rule->mark_ingress,
+										err, errlen) < 0) {
+						goto out;
+				}
+		}
+		ret = 0;
+
+out:
+		close(fd);
+		return ret;
+}
 
-				tcp_info_length = sizeof(tcp_info);
-				if ( getsockopt(proxy->dst.fd, IPPROTO_TCP, TCP_INFO, (void *)&tcp_info,
-										(socklen_t *)&tcp_info_length ) == 0 ) {
-						fprintf(logger.file,",\"rtt\":%u,", tcp_info.tcpi_rtt);
-						fprintf(logger.file,"\"rtt_var\":%u,", tcp_info.tcpi_rttvar);
-						fprintf(logger.file,"\"retransmits\":%u,", tcp_info.tcpi_total_retrans);
-						fprintf(logger.file,"\"cwnd\":%u,", tcp_info.tcpi_snd_cwnd);
-						fprintf(logger.file,"\"pacing_rate\":%u,", tcp_info.tcpi_pacing_rate);
-						fprintf(logger.file,"\"max_pacing_rate\":%u,", tcp_info.tcpi_max_pacing_rate);
-						fprintf(logger.file,"\"delivery_rate\":%lu", tcp_info.tcpi_delivery_rate);
+/*
+ * Build a configuration from the command line options, the
+ * configuration file and the policy file and make it the current one.
+ * On error the current configuration stays, @err says why.
+ */
+static int reload_config(char *err, size_t errlen)
+{
+		struct pep_config *cfg;
+		int ret = -1;
+
+		cfg = calloc(1, sizeof(*cfg));
+		if (!cfg) {
+				snprintf(err, errlen, "out of memory");
+				return -1;
+		}
+
+		pthread_mutex_lock(&reload_lock);
+		*cfg = cmdline_config;
+		atomic_set(&cfg->refcnt, 1);
+		if (config_path && pepconfig_parse(cfg, config_path, err, errlen) < 0) {
+				goto out;
+		}
+		if (policy_path) {
+				cfg->policies = peppolicy_load(policy_path, err, errlen);
+				if (!cfg->policies) {
+						goto out;
 				}
+		}
+		if (check_config(cfg, err, errlen) < 0) {
+				goto out;
+		}
 
+		pepconfig_publish(cfg);
+		syslog(LOG_NOTICE, "configuration %u loaded, %u policy rules",
+						cfg->generation, cfg->policies ? cfg->policies->nr_rules : 0);
+		cfg = NULL;
+		ret = 0;
 
-				fprintf(logger.file, "}");
+out:
+		pthread_mutex_unlock(&reload_lock);
+		if (cfg) {
+				peppolicy_free(cfg->policies);
+				free(cfg);
 		}
-		fprintf(logger.file, "]}\n");
+		return ret;
+}
 
-		SYNTAB_UNLOCK_READ();
-		fflush(logger.file);
+/* Open hardware counters of the calling thread if profiling is on */
+static void init_thread_perf(void)
+{
+		static int warned = 0;
+
+		if (pepperf_thread_init() < 0 &&
+						!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+				pep_warning("Hardware counters are not available! [%s:%d]",
+								strerror(errno), errno);
+		}
 }
 
 static void setup_socket(int fd)
@@ -357,6 +770,21 @@ static struct pep_proxy *alloc_proxy(void)
 static void free_proxy(struct pep_proxy *proxy)
 {
 		assert(atomic_read(&proxy->refcnt) == 0);
+		if (proxy->config) {
+				pepconfig_put(proxy->config);
+		}
+		if (proxy->terminal) {
+				peprate_put(proxy->terminal);
+		}
+		if (proxy->drr_group) {
+				pepdrr_put(proxy->drr_group);
+		}
+
+		/*
+		 * Not in destroy_proxy(): the collector may destroy a pending
+		 * proxy the listener is still sizing the buffers of.
+		 */
+		pepsockbuf_release(proxy->sockbuf);
 		free(proxy);
 }
 
@@ -381,9 +809,15 @@ static void destroy_proxy(struct pep_proxy *proxy)
 				goto out;
 		}
 
+		PEP_TRACE4(destroy, proxy->src.addr, proxy->src.port, proxy->status,
+						proxy->src.stats.bytes_in + proxy->dst.stats.bytes_in);
+		peprec_event(PEPREC_DESTROY, proxy, 0,
+						proxy->src.stats.bytes_in + proxy->dst.stats.bytes_in);
 		proxy->status = PST_CLOSED;
 		PEP_DEBUG_DP(proxy, "Destroy proxy");
+		pepstat_inc(PEPSTAT_DESTROYED);
 
+		pepwatch_call("destroy_proxy", proxy);
 		SYNTAB_LOCK_WRITE();
 		syntab_delete(proxy);
 		proxy->status = PST_CLOSED;
@@ -395,6 +829,8 @@ static void destroy_proxy(struct pep_proxy *proxy)
 						close(proxy->endpoints[i].fd);
 				}
 				if (pepbuf_initialized(&proxy->endpoints[i].buf)) {
+						pepmem_charge(PEPMEM_RELAY,
+										-(int64_t)proxy->endpoints[i].buf.total_size);
 						pepbuf_deinit(&proxy->endpoints[i].buf);
 				}
 		}
@@ -418,7 +854,7 @@ out:
  * connections in SYN table and closes them if a connection hasn't have any
  * activity for a long time.
  */
-static void garbage_connections_collector(void)
+static void garbage_connections_collector(int lifetime)
 {
 		struct pep_proxy *proxy;
 		struct list_node *item, *safe;
@@ -435,8 +871,9 @@ static void garbage_connections_collector(void)
 				}
 
 				t_diff = t_now - proxy->syn_time;
-				if (t_diff >= pending_conn_lifetime) {
+				if (t_diff >= lifetime) {
 						PEP_DEBUG_DP(proxy, "Marked as garbage. Destroying...");
+						peprec_event(PEPREC_EXPIRED, proxy, 0, t_diff);
 						destroy_proxy(proxy);
 				}
 		}
@@ -450,52 +887,138 @@ static ssize_t pep_receive(struct pep_endpoint *endp)
 		ssize_t rb;
 
 		if (endp->iostat & (PEP_IORDONE | PEP_IOERR | PEP_IOEOF) ||
-						pepbuf_full(&endp->buf)) {
+						pepbuf_full(&endp->buf) || endp->throttled) {
 				return 0;
 		}
 
+		pepwatch_call("read", endp->owner);
 		rb = read(endp->fd, PEPBUF_RPOS(&endp->buf),
 						PEPBUF_SPACE_LEFT(&endp->buf));
+		PEP_TRACE5(receive, endp->owner->src.addr, endp->owner->src.port,
+						endp->fd, rb, (rb < 0) ? errno : 0);
+		endp->stats.reads++;
 		if (rb < 0) {
 				if (nonblocking_err_p(errno)) {
+						endp->stats.read_eagain++;
 						endp->iostat |= PEP_IORDONE;
 						return 0;
 				}
 
+				peprec_event(PEPREC_IOERR, endp->owner, errno, endp->fd);
+				pepstat_inc(PEPSTAT_IO_ERRORS);
 				endp->iostat |= PEP_IOERR;
 				return -1;
 		}
 		else if (rb == 0) {
+				peprec_event(PEPREC_RECV, endp->owner, 0, 0);
 				endp->iostat |= PEP_IOEOF;
 				return 0;
 		}
 
+		peprec_event(PEPREC_RECV, endp->owner, 0, rb);
 		pepbuf_update_rpos(&endp->buf, rb);
+		if (!endp->stats.bytes_in) {
+				timeline_mark(endp->owner, (endp == &endp->owner->src) ?
+								PEP_TL_CLIENT_DATA : PEP_TL_SERVER_DATA);
+		}
+		endp->stats.bytes_in += rb;
+		pepstat_add((endp == &endp->owner->src) ?
+						PEPSTAT_BYTES_FROM_CLIENTS : PEPSTAT_BYTES_FROM_SERVERS, rb);
+		if (PEPBUF_SPACE_FILLED(&endp->buf) > endp->stats.buf_peak) {
+				endp->stats.buf_peak = PEPBUF_SPACE_FILLED(&endp->buf);
+		}
+		if (pepbuf_full(&endp->buf)) {
+				endp->stats.buf_full++;
+		}
+
 		return rb;
 }
 
-static ssize_t pep_send(struct pep_endpoint *from, int to_fd)
+/*
+ * Bytes of @len that may be written to @to now. Only writes to the
+ * server side of a connection with a terminal rate are limited; when
+ * the terminal has no tokens left for @to, @to is paced: not written to
+ * before paced_until, the start of its slot.
+ */
+static size_t pep_send_quota(struct pep_endpoint *to, size_t len)
+{
+		struct peprate_bucket *terminal = to->owner->terminal;
+		uint64_t now, wait;
+		int queued;
+
+		if (!terminal || to != &to->owner->dst || !len) {
+				return len;
+		}
+
+		now = pep_clock_ns();
+		if (to->paced_until > now) {
+				return 0;
+		}
+
+		queued = to->paced_until != 0;
+		len = peprate_take(terminal, len, now, queued, &wait);
+		if (!len) {
+				to->paced_until = now + wait;
+				pepstat_inc(PEPSTAT_PACED);
+		}
+		else {
+				to->paced_until = 0;
+		}
+
+		return len;
+}
+
+static ssize_t pep_send(struct pep_endpoint *from, struct pep_endpoint *to)
 {
 		ssize_t wb;
+		size_t len;
 
 		if (from->iostat & (PEP_IOERR | PEP_IOWDONE) ||
 						(pepbuf_empty(&from->buf) && !(from->iostat & PEP_IOEOF))) {
 				return 0;
 		}
 
-		wb = write(to_fd, PEPBUF_WPOS(&from->buf),
-						PEPBUF_SPACE_FILLED(&from->buf));
+		len = PEPBUF_SPACE_FILLED(&from->buf);
+		if (to->owner->drr_group && len > to->owner->drr_left) {
+				len = to->owner->drr_left;
+				to->owner->drr_limited = 1;
+		}
+		len = pep_send_quota(to, len);
+		if (!len && !pepbuf_empty(&from->buf)) {
+				return 0;
+		}
+
+		pepwatch_call("write", to->owner);
+		wb = write(to->fd, PEPBUF_WPOS(&from->buf), len);
+		if (to->owner->terminal && to == &to->owner->dst && wb < (ssize_t)len) {
+				peprate_refund(to->owner->terminal, len - ((wb > 0) ? wb : 0));
+		}
+		PEP_TRACE5(send, to->owner->src.addr, to->owner->src.port,
+						to->fd, wb, (wb < 0) ? errno : 0);
+		to->stats.writes++;
 		if (wb < 0) {
 				if (nonblocking_err_p(errno)) {
+						to->stats.write_eagain++;
 						from->iostat |= PEP_IOWDONE;
 						return 0;
 				}
 
+				peprec_event(PEPREC_IOERR, to->owner, errno, to->fd);
+				pepstat_inc(PEPSTAT_IO_ERRORS);
 				from->iostat |= PEP_IOERR;
 				return -1;
 		}
 
+		peprec_event(PEPREC_SEND, to->owner, 0, wb);
 		pepbuf_update_wpos(&from->buf, wb);
+		if (to->owner->drr_group) {
+				to->owner->drr_left -= wb;
+				to->owner->drr_used += wb;
+		}
+		if (!to->stats.bytes_out && wb > 0 && to == &to->owner->dst) {
+				timeline_mark(to->owner, PEP_TL_SERVER_SENT);
+		}
+		to->stats.bytes_out += wb;
 		return wb;
 }
 
@@ -506,7 +1029,7 @@ static void pep_proxy_data(struct pep_endpoint *from, struct pep_endpoint *to)
 		rb = wb = 1;
 		while ((wb > 0) || (rb > 0)) {
 				rb = pep_receive(from);
-				wb = pep_send(from, to->fd);
+				wb = pep_send(from, to);
 		}
 
 		if (from->iostat & PEP_IOERR) {
@@ -520,7 +1043,8 @@ static void pep_proxy_data(struct pep_endpoint *from, struct pep_endpoint *to)
 		if (pepbuf_full(&from->buf) || (from->iostat & PEP_IOEOF)) {
 				from->poll_events &= ~POLLIN;
 		}
-		else if (from->iostat & PEP_IORDONE) {
+		else if ((from->iostat & PEP_IORDONE) || from->throttled) {
+				/* Throttled endpoints keep POLLIN for when they're released */
 				from->poll_events |= POLLIN;
 		}
 
@@ -558,7 +1082,11 @@ static int save_proxy_from_socket(int sockfd, struct sockaddr_in cliaddr)
 		}
 
 		/* Socket is bound to original destination */
-		if(getsockname(sockfd, (struct sockaddr *) &orig_dst, &addrlen) < 0){
+		if (static_dst) {
+				orig_dst.sin_addr.s_addr = htonl(static_dst_addr);
+				orig_dst.sin_port = htons(static_dst_port);
+		}
+		else if(getsockname(sockfd, (struct sockaddr *) &orig_dst, &addrlen) < 0){
 				pep_warning("Failed to get original dest from socket! [%s:%d]",
 								strerror(errno), errno);
 				ret = -1;
@@ -581,6 +1109,7 @@ static int save_proxy_from_socket(int sockfd, struct sockaddr_in cliaddr)
 		dup = syntab_find(&key);
 		if (dup != NULL) {
 				PEP_DEBUG_DP(dup, "Duplicate SYN. Dropping...");
+				pepstat_inc(PEPSTAT_DUP_SYNS);
 				SYNTAB_UNLOCK_WRITE();
 				goto err;
 		}
@@ -615,96 +1144,297 @@ err:
 		return ret;
 }
 
-
-void *listener_loop(void UNUSED(*unused))
+/*
+ * Set the socket options the policy of @proxy overrides on its client
+ * socket @connfd and server socket @out_fd, before connecting to the
+ * server. The listener already answered the client's SYN, so ingress
+ * MSS and buffer sizes only affect what is sent from now on. Failures
+ * are not fatal, the connection keeps the defaults.
+ */
+static void apply_policy(struct pep_proxy *proxy, int connfd, int out_fd)
 {
-		int                 listenfd, optval, ret, connfd, out_fd;
-		struct sockaddr_in  cliaddr, servaddr, r_servaddr;
-		socklen_t           len;
-		struct pep_proxy   *proxy;
-		struct hostent     *host;
-		char                ipbuf[17], ipbuf1[17];
-		unsigned short      r_port, c_port;
-		struct syntab_key   key;
-		int					ingress_maxseg;
-
-		listenfd = socket(AF_INET, SOCK_STREAM, 0);
-		if (listenfd < 0) {
-				pep_error("Failed to create listener socket!");
-		}
-
-		PEP_DEBUG("Opened listener socket: %d", listenfd);
-		memset(&servaddr, 0, sizeof(servaddr));
-
-		servaddr.sin_family = AF_INET;
-		servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-		servaddr.sin_port = htons(portnum);
+		struct pep_policy *policy = proxy->policy;
+		int ret, maxseg;
 
-		optval = 1;
-		ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,
-						&optval, sizeof(optval));
-		if (ret < 0) {
-				pep_error("Failed to set SOL_REUSEADDR option! [RET = %d]", ret);
+		if (policy->mark_egress) {
+				ret = setsockopt(out_fd, SOL_SOCKET, SO_MARK,
+								&policy->mark_egress, sizeof(policy->mark_egress));
+				if (ret < 0) {
+						pep_warning("Policy %s: failed to set egress mark to %u [%s]",
+										policy->name, policy->mark_egress, strerror(errno));
+				}
 		}
-
-		/* Set socket transparent (able to bind to external address) */
-		ret = setsockopt(listenfd, SOL_IP, IP_TRANSPARENT,
-						&optval, sizeof(optval));
-		if (ret < 0) {
-				pep_error("Failed to set IP_TRANSPARENT option! [RET = %d]", ret);
+		if (policy->mark_ingress) {
+				ret = setsockopt(connfd, SOL_SOCKET, SO_MARK,
+								&policy->mark_ingress, sizeof(policy->mark_ingress));
+				if (ret < 0) {
+						pep_warning("Policy %s: failed to set ingress mark to %u [%s]",
+										policy->name, policy->mark_ingress, strerror(errno));
+				}
 		}
 
-		if (mark_ingress > 0) {
-				ret = setsockopt(listenfd, SOL_SOCKET, SO_MARK,
-								&mark_ingress, sizeof(mark_ingress));
+		if (policy->cc_egress[0]) {
+				ret = setsockopt(out_fd, IPPROTO_TCP, TCP_CONGESTION,
+								policy->cc_egress, strlen(policy->cc_egress));
 				if (ret < 0) {
-						pep_error("Failed to set ingress mark to %d [%d]",
-										mark_ingress, ret);
+						pep_warning("Policy %s: failed to set egress tcp algorithm to %s [%s]",
+										policy->name, policy->cc_egress, strerror(errno));
 				}
 		}
-
-		if (strlen(tcp_congestion_algo_ingress) > 0) {
-				ret = setsockopt(listenfd, IPPROTO_TCP, TCP_CONGESTION,
-								tcp_congestion_algo_ingress,
-								strlen(tcp_congestion_algo_ingress));
+		if (policy->cc_ingress[0]) {
+				ret = setsockopt(connfd, IPPROTO_TCP, TCP_CONGESTION,
+								policy->cc_ingress, strlen(policy->cc_ingress));
 				if (ret < 0) {
-						pep_error("Failed to set ingress tcp algorithm to %s [%d]",
-										tcp_congestion_algo_ingress, ret);
+						pep_warning("Policy %s: failed to set ingress tcp algorithm to %s [%s]",
+										policy->name, policy->cc_ingress, strerror(errno));
 				}
 		}
 
-		/* Set TCP_FASTOPEN socket option */
-		if (fastopen) {
-				optval = 5;
-				ret = setsockopt(listenfd, IPPROTO_TCP, TCP_FASTOPEN,
-								&optval, sizeof(optval));
+		if (policy->mtu_ingress) {
+				maxseg = policy->mtu_ingress - IP_HEADER_SIZE - TCP_HEADER_SIZE;
+				if (maxseg > MAX_TCP_WINDOW) {
+						maxseg = MAX_TCP_WINDOW;
+				}
+				ret = setsockopt(connfd, IPPROTO_TCP, TCP_MAXSEG,
+								&maxseg, sizeof(maxseg));
 				if (ret < 0) {
-						pep_error("Failed to set TCP_FASTOPEN option! [RET = %d]", ret);
+						pep_warning("Policy %s: failed to set ingress TCP_MAXSEG to %d [%s]",
+										policy->name, maxseg, strerror(errno));
 				}
 		}
 
-		/* update ingress MSS if required */
-		if (ingress_mtu > 80) {
-				ingress_maxseg = ingress_mtu - IP_HEADER_SIZE - TCP_HEADER_SIZE;
+		if (policy->sndbuf) {
+				if (setsockopt(connfd, SOL_SOCKET, SO_SNDBUF, &policy->sndbuf,
+										sizeof(policy->sndbuf)) < 0 ||
+								setsockopt(out_fd, SOL_SOCKET, SO_SNDBUF, &policy->sndbuf,
+										sizeof(policy->sndbuf)) < 0) {
+						pep_warning("Policy %s: failed to set SO_SNDBUF to %d [%s]",
+										policy->name, policy->sndbuf, strerror(errno));
+				}
+		}
+		if (policy->rcvbuf) {
+				if (setsockopt(connfd, SOL_SOCKET, SO_RCVBUF, &policy->rcvbuf,
+										sizeof(policy->rcvbuf)) < 0 ||
+								setsockopt(out_fd, SOL_SOCKET, SO_RCVBUF, &policy->rcvbuf,
+										sizeof(policy->rcvbuf)) < 0) {
+						pep_warning("Policy %s: failed to set SO_RCVBUF to %d [%s]",
+										policy->name, policy->rcvbuf, strerror(errno));
+				}
+		}
+}
 
-                if (ingress_maxseg > MAX_TCP_WINDOW) {
-                    ingress_maxseg = MAX_TCP_WINDOW;
-                }
+/*
+ * Size the buffers of the server socket @out_fd for the link profile
+ * of @proxy, its policy's or else the configuration's. Buffer sizes
+ * set by the policy take precedence. Called before connecting, so
+ * that the receive window scale is chosen for the new size.
+ */
+static void size_egress_buffers(struct pep_proxy *proxy, int out_fd)
+{
+		struct pep_config *cfg = proxy->config;
+		struct pep_policy *policy = proxy->policy;
+		unsigned int rate = cfg->link_rate, rtt = cfg->link_rtt;
 
-				ret = setsockopt(listenfd, IPPROTO_TCP, TCP_MAXSEG,
-								&ingress_maxseg, sizeof(ingress_maxseg));
-				if (ret < 0) {
-					pep_error("Failed to set ingress TCP_MAXSEG to %d [RET = %d]", ingress_maxseg, ret);
+		if (policy) {
+				if (policy->sndbuf || policy->rcvbuf) {
+						return;
+				}
+				if (policy->link_rate) {
+						rate = policy->link_rate;
+				}
+				if (policy->link_rtt) {
+						rtt = policy->link_rtt;
 				}
 		}
-
-		ret = bind(listenfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
-		if (ret < 0) {
-				pep_error("Failed to bind socket! [RET = %d]", ret);
+		if (!rate || !rtt) {
+				return;
 		}
 
-		ret = listen(listenfd, LISTENER_QUEUE_SIZE);
-		if (ret < 0) {
+		proxy->sockbuf = pepsockbuf_set(out_fd, 0,
+						pepsockbuf_bdp((uint64_t)rate * 125, (uint64_t)rtt * 1000),
+						&cfg->sockbuf, cfg->mem_budget);
+}
+
+/*
+ * Apply the rate limits of the link profile of @proxy to its server
+ * side socket @out_fd: the per connection pacing rate, and the bucket
+ * shared by the connections of the same client. Settings of the policy
+ * take precedence.
+ */
+static void limit_egress_rate(struct pep_proxy *proxy, int out_fd)
+{
+		struct pep_config *cfg = proxy->config;
+		struct pep_policy *policy = proxy->policy;
+		unsigned int pacing = cfg->pacing_rate, rate = cfg->terminal_rate;
+		unsigned int burst = cfg->terminal_burst;
+
+		if (policy) {
+				if (policy->pacing_rate) {
+						pacing = policy->pacing_rate;
+				}
+				if (policy->terminal_rate) {
+						rate = policy->terminal_rate;
+				}
+				if (policy->terminal_burst) {
+						burst = policy->terminal_burst;
+				}
+		}
+
+		if (pacing && peprate_pacing(out_fd, (uint64_t)pacing * 125) < 0) {
+				pep_warning("Failed to set pacing rate to %u kbit/s! [%s:%d]",
+								pacing, strerror(errno), errno);
+		}
+		if (rate) {
+				proxy->terminal = peprate_get(proxy->src.addr,
+								(uint64_t)rate * 125, burst);
+		}
+}
+
+/*
+ * Set the ingress options of @cfg on the listening socket, accepted
+ * connections inherit them. Only called by the listener; options are
+ * only set again when a reload changed them, an option that is no
+ * longer set goes back to the kernel default. Returns -1 if one of
+ * them could not be set.
+ */
+static int configure_listener(int listenfd, struct pep_config *cfg)
+{
+		static unsigned int generation = 0, mark = 0;
+		static int maxseg = 0;
+		static char cc[PEPPOLICY_CC_SZ] = "", default_cc[PEPPOLICY_CC_SZ] = "";
+		const char *algo;
+		socklen_t len;
+		int ret, seg = 0, err = 0;
+
+		if (cfg->generation == generation) {
+				return 0;
+		}
+		generation = cfg->generation;
+
+		if (!default_cc[0]) {
+				len = sizeof(default_cc) - 1;
+				getsockopt(listenfd, IPPROTO_TCP, TCP_CONGESTION, default_cc, &len);
+		}
+
+		if (cfg->mark_ingress != mark) {
+				ret = setsockopt(listenfd, SOL_SOCKET, SO_MARK,
+								&cfg->mark_ingress, sizeof(cfg->mark_ingress));
+				if (ret < 0) {
+						pep_warning("Failed to set ingress mark to %u [%s]",
+										cfg->mark_ingress, strerror(errno));
+						err = -1;
+				}
+				else {
+						mark = cfg->mark_ingress;
+				}
+		}
+
+		if (strcmp(cfg->cc_ingress, cc)) {
+				algo = cfg->cc_ingress[0] ? cfg->cc_ingress : default_cc;
+				ret = setsockopt(listenfd, IPPROTO_TCP, TCP_CONGESTION,
+								algo, strlen(algo));
+				if (ret < 0) {
+						pep_warning("Failed to set ingress tcp algorithm to %s [%s]",
+										algo, strerror(errno));
+						err = -1;
+				}
+				else {
+						strcpy(cc, cfg->cc_ingress);
+				}
+		}
+
+		/* update ingress MSS if required, 0 restores the default */
+		if (cfg->ingress_mtu > 80) {
+				seg = cfg->ingress_mtu - IP_HEADER_SIZE - TCP_HEADER_SIZE;
+				if (seg > MAX_TCP_WINDOW) {
+						seg = MAX_TCP_WINDOW;
+				}
+		}
+		if (seg != maxseg) {
+				ret = setsockopt(listenfd, IPPROTO_TCP, TCP_MAXSEG,
+								&seg, sizeof(seg));
+				if (ret < 0) {
+						pep_warning("Failed to set ingress TCP_MAXSEG to %d [%s]",
+										seg, strerror(errno));
+						err = -1;
+				}
+				else {
+						maxseg = seg;
+				}
+		}
+
+		return err;
+}
+
+void *listener_loop(void UNUSED(*unused))
+{
+		int                 listenfd, optval, ret, connfd, out_fd;
+		struct sockaddr_in  cliaddr, servaddr, r_servaddr;
+		socklen_t           len;
+		struct pep_proxy   *proxy;
+		struct hostent     *host;
+		char                ipbuf[17], ipbuf1[17];
+		unsigned short      r_port, c_port;
+		struct syntab_key   key;
+		struct pep_config  *cfg;
+		unsigned int        mark_egress;
+		const char         *cc_egress;
+		uint64_t            accept_ts;
+		struct pepperf_sample perf_start;
+
+		pepstat_thread_init("listener");
+		init_thread_perf();
+		listenfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (listenfd < 0) {
+				pep_error("Failed to create listener socket!");
+		}
+
+		PEP_DEBUG("Opened listener socket: %d", listenfd);
+		memset(&servaddr, 0, sizeof(servaddr));
+
+		servaddr.sin_family = AF_INET;
+		servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+		servaddr.sin_port = htons(portnum);
+
+		optval = 1;
+		ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,
+						&optval, sizeof(optval));
+		if (ret < 0) {
+				pep_error("Failed to set SOL_REUSEADDR option! [RET = %d]", ret);
+		}
+
+		/* Set socket transparent (able to bind to external address) */
+		if (!static_dst) {
+				ret = setsockopt(listenfd, SOL_IP, IP_TRANSPARENT,
+								&optval, sizeof(optval));
+				if (ret < 0) {
+						pep_error("Failed to set IP_TRANSPARENT option! [RET = %d]", ret);
+				}
+		}
+
+		/* Set TCP_FASTOPEN socket option */
+		if (fastopen) {
+				optval = 5;
+				ret = setsockopt(listenfd, IPPROTO_TCP, TCP_FASTOPEN,
+								&optval, sizeof(optval));
+				if (ret < 0) {
+						pep_error("Failed to set TCP_FASTOPEN option! [RET = %d]", ret);
+				}
+		}
+
+		cfg = pepconfig_get();
+		if (configure_listener(listenfd, cfg) < 0) {
+				pep_error("Failed to set the ingress options of the listener socket!");
+		}
+		pepconfig_put(cfg);
+
+		ret = bind(listenfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
+		if (ret < 0) {
+				pep_error("Failed to bind socket! [RET = %d]", ret);
+		}
+
+		ret = listen(listenfd, LISTENER_QUEUE_SIZE);
+		if (ret < 0) {
 				pep_error("Failed to set quesize of listenfd to %d! [RET = %d]",
 								LISTENER_QUEUE_SIZE, ret);
 		}
@@ -714,21 +1444,33 @@ void *listener_loop(void UNUSED(*unused))
 		for (;;) {
 				out_fd = -1;
 				proxy = NULL;
+				cfg = NULL;
 
 				len = sizeof(struct sockaddr_in);
 				connfd = accept(listenfd, (struct sockaddr *)&cliaddr, &len);
 				if (connfd < 0) {
 						pep_warning("accept() failed! [Errno: %s, %d]",
 										strerror(errno), errno);
+						pepstat_inc(PEPSTAT_ACCEPT_ERRORS);
 						continue;
 				}
 
+				accept_ts = pep_clock_ns();
+				pepperf_begin(&perf_start);
+				pepstat_inc(PEPSTAT_ACCEPTED);
+
+				/* Connections keep the configuration they were accepted with */
+				cfg = pepconfig_get();
+				configure_listener(listenfd, cfg);
+
 				/*
 				 * Try to find incomming connection in our SYN table
 				 * It must be already there waiting for activation.
 				 */
 				key.addr = ntohl(cliaddr.sin_addr.s_addr);
 				key.port = ntohs(cliaddr.sin_port);
+				PEP_TRACE3(accept, ntohl(cliaddr.sin_addr.s_addr),
+								ntohs(cliaddr.sin_port), connfd);
 				toip(ipbuf, key.addr);
 				PEP_DEBUG("New incomming connection: %s:%d", ipbuf, key.port);
 
@@ -767,6 +1509,12 @@ void *listener_loop(void UNUSED(*unused))
 				pin_proxy(proxy);
 				assert(proxy->status == PST_PENDING);
 				SYNTAB_UNLOCK_READ();
+				proxy->timeline[PEP_TL_ACCEPT] = accept_ts;
+				proxy->config = cfg;
+				cfg = NULL;
+				proxy->policy = peppolicy_lookup(proxy->config->policies,
+								proxy->src.addr, proxy->dst.addr);
+				peprec_event(PEPREC_ACCEPT, proxy, 0, connfd);
 
 				toip(ipbuf, proxy->dst.addr);
 				r_port = proxy->dst.port;
@@ -792,32 +1540,46 @@ void *listener_loop(void UNUSED(*unused))
 				out_fd = ret;
 				fcntl(out_fd, F_SETFL, O_NONBLOCK);
 
-				if (mark_egress > 0) {
+				mark_egress = proxy->config->mark_egress;
+				if (mark_egress > 0 && !(proxy->policy && proxy->policy->mark_egress)) {
 						ret = setsockopt(out_fd, SOL_SOCKET, SO_MARK,
 										&mark_egress, sizeof(mark_egress));
 						if (ret < 0) {
-								pep_error("Failed to set egress mark to %d [%d]",
-												mark_egress, ret);
+								pep_warning("Failed to set egress mark to %d [%s]",
+												mark_egress, strerror(errno));
 						}
 				}
 
-				if (strlen(tcp_congestion_algo_egress) > 0) {
+				cc_egress = proxy->config->cc_egress;
+				if (strlen(cc_egress) > 0 &&
+								!(proxy->policy && proxy->policy->cc_egress[0])) {
 						ret = setsockopt(out_fd, IPPROTO_TCP, TCP_CONGESTION,
-										tcp_congestion_algo_egress,
-										strlen(tcp_congestion_algo_egress));
+										cc_egress, strlen(cc_egress));
 						if (ret < 0) {
-								pep_error("Failed to set egress tcp algorithm to %s [%d]",
-												tcp_congestion_algo_egress, ret);
+								pep_warning("Failed to set egress tcp algorithm to %s [%s]",
+												cc_egress, strerror(errno));
 						}
 				}
 
+				if (proxy->policy) {
+						apply_policy(proxy, connfd, out_fd);
+				}
+				size_egress_buffers(proxy, out_fd);
+				limit_egress_rate(proxy, out_fd);
+				if (proxy->config->drr_quantum) {
+						proxy->drr_group = pepdrr_get(proxy->src.addr,
+										proxy->config->drr_prefix, proxy->config->drr_quantum);
+				}
+
 				/*
 				 * Set outbound endpoint to transparent mode
 				 */
-				ret = setsockopt(out_fd, SOL_IP, IP_TRANSPARENT,
-								&optval, sizeof(optval));
-				if (ret < 0) {
-						pep_error("Failed to set IP_TRANSPARENT option! [RET = %d]", ret);
+				if (!static_dst) {
+						ret = setsockopt(out_fd, SOL_IP, IP_TRANSPARENT,
+										&optval, sizeof(optval));
+						if (ret < 0) {
+								pep_error("Failed to set IP_TRANSPARENT option! [RET = %d]", ret);
+						}
 				}
 
 				if (fastopen) {
@@ -828,11 +1590,16 @@ void *listener_loop(void UNUSED(*unused))
 						ret = connect(out_fd, (struct sockaddr *)&r_servaddr,
 										sizeof(r_servaddr));
 				}
+				pepstat_inc(PEPSTAT_CONNECTS);
+				peprec_event(PEPREC_CONNECT, proxy, (ret < 0) ? errno : 0, out_fd);
 				if ((ret < 0) && !nonblocking_err_p(errno)) {
 						pep_warning("Failed to connect! [%s:%d]", strerror(errno), errno);
+						pepstat_inc(PEPSTAT_CONNECT_ERRORS);
 						goto close_connection;
 				}
 
+				timeline_mark(proxy, PEP_TL_CONNECT);
+
 				proxy->src.fd = connfd;
 				proxy->dst.fd = out_fd;
 				if (proxy->status == PST_CLOSED) {
@@ -848,6 +1615,7 @@ void *listener_loop(void UNUSED(*unused))
 										POLLER_NEWCONN_SIG);
 				}
 
+				pepperf_end(PEPPERF_ACCEPT, &perf_start);
 				continue;
 
 close_connection:
@@ -866,6 +1634,10 @@ close_connection:
 				if (proxy) {
 						destroy_proxy(proxy);
 				}
+				if (cfg) {
+						pepconfig_put(cfg);
+				}
+				pepperf_end(PEPPERF_ACCEPT, &perf_start);
 		}
 
 		/* Normally this code won't be executed */
@@ -873,13 +1645,19 @@ close_connection:
 		pthread_exit(NULL);
 }
 
-static int prepare_poll_resources(void)
+/*
+ * Fill the poll set. Paced endpoints (see peprate.h) aren't polled for
+ * writing; @timeout is set to the milliseconds until the first of them
+ * may be written to again, -1 if there are none.
+ */
+static int prepare_poll_resources(int *timeout)
 {
 		struct pep_proxy *proxy;
 		struct pep_endpoint *endp;
 		struct pollfd *pfd;
 		int i, j;
 		enum proxy_status stat;
+		uint64_t now = pep_clock_ns(), next = 0;
 
 		i = 0;
 		SYNTAB_LOCK_READ();
@@ -900,6 +1678,15 @@ static int prepare_poll_resources(void)
 						pfd = &poll_resources.pollfds[i];
 						pfd->fd = endp->fd;
 						pfd->events = endp->poll_events;
+						if (endp->throttled) {
+								pfd->events &= ~POLLIN;
+						}
+						if (endp->paced_until > now) {
+								pfd->events &= ~POLLOUT;
+								if (!next || endp->paced_until < next) {
+										next = endp->paced_until;
+								}
+						}
 						pfd->revents = 0;
 						poll_resources.endpoints[i] = endp;
 						i++;
@@ -907,18 +1694,102 @@ static int prepare_poll_resources(void)
 		}
 
 		SYNTAB_UNLOCK_READ();
+		*timeout = next ? (next - now + 999999) / 1000000 : -1;
 		return i;
 }
 
+/* Relay buffer size of @proxy without memory pressure, 0 for the default */
+static size_t proxy_relay_size(struct pep_proxy *proxy)
+{
+		if (proxy->policy && proxy->policy->relay_buf) {
+				return proxy->policy->relay_buf;
+		}
+
+		return proxy->config->relay_buf;
+}
+
+/* Whether @proxy gives up buffer memory at pressure @level */
+static int should_shrink(struct pep_proxy *proxy, int level, time_t now)
+{
+		int prio = proxy->policy ? proxy->policy->priority : PEPPOLICY_PRIO_NORMAL;
+		time_t last = proxy->last_rxtx ? proxy->last_rxtx : proxy->syn_time;
+
+		if (level == PEPPRESSURE_NONE || !proxy->config->pressure) {
+				return 0;
+		}
+		if (prio == PEPPOLICY_PRIO_LOW || now - last >= PEPPRESSURE_IDLE) {
+				return 1;
+		}
+
+		return level == PEPPRESSURE_HIGH && prio == PEPPOLICY_PRIO_NORMAL;
+}
+
+/*
+ * Shrink the relay buffer of @endp to @size bytes (0 for the default
+ * size), or grow a shrunk one back to it. Only empty buffers are
+ * swapped, the others are retried on the next pass. Growing must fit
+ * in @budget.
+ */
+static void resize_relay(struct pep_endpoint *endp, size_t size, size_t budget)
+{
+		struct pep_buffer buf;
+		size_t cur = endp->buf.total_size;
+
+		size = pepbuf_size(size);
+		if (size == cur || (size > cur && !endp->relay_shrunk) ||
+						!pepbuf_empty(&endp->buf) ||
+						(size > cur && !pepmem_fits(budget, size - cur))) {
+				return;
+		}
+
+		memset(&buf, 0, sizeof(buf));
+		if (pepbuf_init(&buf, size) < 0) {
+				return;
+		}
+		pepbuf_deinit(&endp->buf);
+		endp->buf = buf;
+		endp->relay_shrunk = (size < cur);
+		pepmem_charge(PEPMEM_RELAY, (int64_t)size - cur);
+		pepstat_inc((size < cur) ? PEPSTAT_PRESSURE_SHRINKS : PEPSTAT_PRESSURE_RESTORES);
+}
+
+/*
+ * Shrink the relay buffers of the connections that give up memory at
+ * the current pressure level to the default size, restore the others.
+ * Runs in the poller, between batches.
+ */
+static void relay_pressure(void)
+{
+		struct pep_proxy *proxy;
+		time_t now = time(NULL);
+		size_t size;
+		int i, shrunk = 0;
+		int level = __atomic_load_n(&pressure_level, __ATOMIC_RELAXED);
+
+		SYNTAB_LOCK_READ();
+		syntab_foreach_connection(proxy) {
+				if (proxy->status != PST_OPEN) {
+						continue;
+				}
+
+				size = should_shrink(proxy, level, now) ? 0 : proxy_relay_size(proxy);
+				for (i = 0; i < PROXY_ENDPOINTS; i++) {
+						resize_relay(&proxy->endpoints[i], size, proxy->config->mem_budget);
+						shrunk += proxy->endpoints[i].relay_shrunk;
+				}
+		}
+		SYNTAB_UNLOCK_READ();
+		shrunk_relays = shrunk;
+}
+
 /* An empty signal handler. It only needed to interrupt poll() */
-static void poller_sighandler(int signo)
+static void poller_sighandler(int UNUSED(signo))
 {
-		PEP_DEBUG("Received signal %d", signo);
 }
 
 static void *poller_loop(void  __attribute__((unused)) *unused)
 {
-		int pollret, num_works, i, num_clients, iostat;
+		int pollret, num_works, i, num_clients, iostat, timeout;
 		struct pep_proxy *proxy;
 		struct pep_endpoint *endp, *target;
 		struct pollfd *pollfd;
@@ -926,7 +1797,11 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 		struct list_head local_list;
 		sigset_t sigset;
 		struct sigaction sa;
+		uint64_t poll_ts, batch_ts, round = 0;
+		struct pepperf_sample perf_start;
 
+		pepstat_thread_init("poller");
+		init_thread_perf();
 		sigemptyset(&sigset);
 		sigaddset(&sigset, POLLER_NEWCONN_SIG);
 		memset(&sa, 0, sizeof(sa));
@@ -952,7 +1827,16 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 				 * It performs poll() be preperly interrupted and renew descriptors.
 				 */
 				sigprocmask(SIG_BLOCK, &sigset, NULL);
-				num_clients = prepare_poll_resources();
+				if (relay_check_requested) {
+						relay_check_requested = 0;
+						pepwatch_begin("relay_pressure");
+						relay_pressure();
+				}
+				pepwatch_begin("prepare_poll_resources");
+				pepperf_begin(&perf_start);
+				num_clients = prepare_poll_resources(&timeout);
+				pepperf_end(PEPPERF_POLL_REBUILD, &perf_start);
+				pepwatch_idle();
 				if (!num_clients) {
 						sigprocmask(SIG_UNBLOCK, &sigset, NULL);
 						sigwaitinfo(&sigset, NULL);
@@ -960,7 +1844,7 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 				}
 
 				sigprocmask(SIG_UNBLOCK, &sigset, NULL);
-				pollret = poll(poll_resources.pollfds, num_clients, -1);
+				pollret = poll(poll_resources.pollfds, num_clients, timeout);
 				if (pollret < 0) {
 						if (errno == EINTR) {
 								/* It seems that new client just appered. Renew descriptors. */
@@ -973,7 +1857,10 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 						continue;
 				}
 
+				poll_ts = pep_clock_ns();
+				pepwatch_begin("dispatch");
 				num_works = 0;
+				round++;
 				for (i = 0; i < num_clients; i++) {
 						pollfd = &poll_resources.pollfds[i];
 						if (!pollfd->revents) {
@@ -989,25 +1876,45 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 								case PST_CONNECT:
 										{
 												int ret, connerr, errlen = sizeof(int);
+												size_t relay_buf;
 
+												pepwatch_call("connect completion", proxy);
 												getsockopt(proxy->dst.fd, SOL_SOCKET, SO_ERROR,
 																&connerr, &errlen);
+												PEP_TRACE3(connect, proxy->src.addr, proxy->src.port,
+																connerr);
+												peprec_event(PEPREC_CONNECTED, proxy, connerr, 0);
 												if (connerr != 0) {
+														pepstat_inc(PEPSTAT_CONNECT_ERRORS);
 														destroy_proxy(proxy);
 														break;
 												}
 
-												ret = pepbuf_init(&proxy->src.buf);
+												pepstat_inc(PEPSTAT_ESTABLISHED);
+												timeline_mark(proxy, PEP_TL_ESTABLISHED);
+												pephist_record(PEPHIST_ACCEPT_CONNECT,
+																proxy->timeline[PEP_TL_ESTABLISHED] -
+																proxy->timeline[PEP_TL_ACCEPT]);
+
+												relay_buf = proxy_relay_size(proxy);
+												if (relay_buf && !pepmem_fits(proxy->config->mem_budget,
+																		2 * relay_buf)) {
+														pepstat_inc(PEPSTAT_RELAY_CAPPED);
+														relay_buf = 0;
+												}
+												ret = pepbuf_init(&proxy->src.buf, relay_buf);
 												if (ret < 0) {
 														pep_error("Failed to allocate PEP IN buffer!");
 												}
 
-												ret = pepbuf_init(&proxy->dst.buf);
+												ret = pepbuf_init(&proxy->dst.buf, relay_buf);
 												if (ret < 0) {
 														pepbuf_deinit(&proxy->src.buf);
 														pep_error("Failed to allocate PEP OUT buffer!");
 												}
 
+												pepmem_charge(PEPMEM_RELAY, proxy->src.buf.total_size +
+																proxy->dst.buf.total_size);
 												proxy->status = PST_OPEN;
 												setup_socket(proxy->src.fd);
 												setup_socket(proxy->dst.fd);
@@ -1027,6 +1934,10 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 														list_add2tail(&local_list, &proxy->qnode);
 														num_works++;
 														proxy->enqueued = 1;
+														proxy->ready_ts = poll_ts;
+														if (proxy->drr_group) {
+																pepdrr_ready(proxy->drr_group, round);
+														}
 												}
 
 												break;
@@ -1037,6 +1948,16 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 						continue;
 				}
 
+				/* Share the deficit of every group among its ready connections */
+				list_for_each(&local_list, entry) {
+						proxy = list_entry(entry, struct pep_proxy, qnode);
+						if (proxy->drr_group) {
+								proxy->drr_left = pepdrr_share(proxy->drr_group);
+								proxy->drr_used = 0;
+								proxy->drr_limited = 0;
+						}
+				}
+
 				/*
 				 * Now we're able to give connections with ready I/O status
 				 * to worker threads. Worker threads from PEPsal threads pool
@@ -1045,6 +1966,8 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 				 * Poller loop will wait until all connections it gave to worker
 				 * threads will be fully handled.
 				 */
+				batch_ts = pep_clock_ns();
+				pepwatch_call("wait for workers", NULL);
 				PEPQUEUE_LOCK(&active_queue);
 				pepqueue_enqueue_list(&active_queue, &local_list, num_works);
 
@@ -1060,6 +1983,8 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 				list_init_head(&local_list);
 				pepqueue_dequeue_list(&ready_queue, &local_list);
 				PEPQUEUE_UNLOCK(&ready_queue);
+				pephist_record_since(PEPHIST_READY_TURNAROUND, batch_ts);
+				pepwatch_call("ready queue", NULL);
 
 				/*
 				 * Now it's a time to handle connections after I/O is completed.
@@ -1070,6 +1995,10 @@ static void *poller_loop(void  __attribute__((unused)) *unused)
 				list_for_each_safe(&local_list, entry, safe) {
 						proxy = list_entry(entry, struct pep_proxy, qnode);
 						proxy->enqueued = 0;
+						if (proxy->drr_group) {
+								pepdrr_charge(proxy->drr_group, proxy->drr_used,
+												proxy->drr_limited);
+						}
 						for (i = 0; i < PROXY_ENDPOINTS; i++) {
 								endp = &proxy->endpoints[i];
 								iostat = endp->iostat;
@@ -1091,19 +2020,31 @@ static void *workers_loop(void __attribute__((unused)) *unused)
 		struct pep_proxy *proxy;
 		struct list_head local_list;
 		int ret, ready_items;
+		uint64_t start_ts;
+		struct pepperf_sample perf_start;
 
+		pepstat_thread_init("worker");
+		init_thread_perf();
 		PEPQUEUE_LOCK(&active_queue);
 		for (;;) {
 				list_init_head(&local_list);
 				ready_items = 0;
+				pepwatch_idle();
 				PEPQUEUE_WAIT(&active_queue);
+				pepwatch_begin("dequeue");
 
 				while (active_queue.num_items > 0) {
 						proxy = pepqueue_dequeue(&active_queue);
 						PEPQUEUE_UNLOCK(&active_queue);
 
+						start_ts = pep_clock_ns();
+						pepwatch_call("pep_proxy_data", proxy);
+						pephist_record(PEPHIST_POLL_DISPATCH, start_ts - proxy->ready_ts);
+						pepperf_begin(&perf_start);
 						pep_proxy_data(&proxy->src, &proxy->dst);
 						pep_proxy_data(&proxy->dst, &proxy->src);
+						pepperf_end(PEPPERF_PROXY_DATA, &perf_start);
+						pephist_record_since(PEPHIST_WORKER_SERVICE, start_ts);
 
 						proxy->last_rxtx = time(NULL);
 						list_add2tail(&local_list, &proxy->qnode);
@@ -1112,6 +2053,7 @@ static void *workers_loop(void __attribute__((unused)) *unused)
 						PEPQUEUE_LOCK(&active_queue);
 				}
 
+				pepwatch_call("ready queue", NULL);
 				PEPQUEUE_LOCK(&ready_queue);
 				pepqueue_enqueue_list(&ready_queue, &local_list, ready_items);
 				PEPQUEUE_UNLOCK(&ready_queue);
@@ -1119,10 +2061,258 @@ static void *workers_loop(void __attribute__((unused)) *unused)
 		}
 }
 
+/*
+ * Measured socket buffer sizing: resize the server side buffers of
+ * established connections to twice their measured BDP. Buffers are
+ * only grown by more than a quarter or shrunk by more than half, so
+ * that sizes don't follow every fluctuation of the estimates.
+ *
+ * Every pass takes the next PEPSOCKBUF_BATCH connections of the SYN
+ * table, so that the TCP_INFO calls made under its lock stay bounded
+ * however many connections there are.
+ */
+static void sockbuf_resize(void)
+{
+		static unsigned int cursor = 0;
+		struct pep_proxy *proxy;
+		struct list_node *item;
+		struct tcp_info info;
+		socklen_t len;
+		size_t want;
+		unsigned int pos = 0, done = 0;
+
+		SYNTAB_LOCK_READ();
+		list_for_each(&GET_SYNTAB()->conns, item) {
+				if (pos++ < cursor) {
+						continue;
+				}
+				if (done++ == PEPSOCKBUF_BATCH) {
+						break;
+				}
+
+				proxy = list_entry(item, struct pep_proxy, lnode);
+				if (proxy->status != PST_OPEN || proxy->dst.fd < 0 ||
+								proxy->dst.shrunk ||
+								!proxy->config || !proxy->config->sockbuf_auto ||
+								(proxy->policy &&
+								 (proxy->policy->sndbuf || proxy->policy->rcvbuf))) {
+						continue;
+				}
+
+				len = sizeof(info);
+				if (getsockopt(proxy->dst.fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0 ||
+								!info.tcpi_rtt || !info.tcpi_delivery_rate) {
+						continue;
+				}
+
+				want = 2 * pepsockbuf_bdp(info.tcpi_delivery_rate, info.tcpi_rtt);
+				if (want > (size_t)proxy->sockbuf + proxy->sockbuf / 4 ||
+								want < (size_t)proxy->sockbuf / 2) {
+						proxy->sockbuf = pepsockbuf_set(proxy->dst.fd, proxy->sockbuf,
+										want, &proxy->config->sockbuf,
+										proxy->config->mem_budget);
+				}
+		}
+		SYNTAB_UNLOCK_READ();
+
+		/* Start over from the head once the end of the table was reached */
+		cursor = (done > PEPSOCKBUF_BATCH) ? cursor + PEPSOCKBUF_BATCH : 0;
+}
+
+/*
+ * Release the endpoints still throttled after the budget was removed
+ * by a reload.
+ */
+static void memory_unthrottle(void)
+{
+		struct pep_proxy *proxy;
+		int i;
+
+		SYNTAB_LOCK_READ();
+		syntab_foreach_connection(proxy) {
+				for (i = 0; i < PROXY_ENDPOINTS; i++) {
+						proxy->endpoints[i].throttled = 0;
+						proxy->endpoints[i].queued = 0;
+				}
+		}
+		SYNTAB_UNLOCK_READ();
+
+		throttled_endpoints = 0;
+		pepmem_set(PEPMEM_QUEUED, 0);
+		if (pthread_kill(poller, POLLER_NEWCONN_SIG) != 0) {
+				pep_warning("Failed to send %d signal to poller thread",
+								POLLER_NEWCONN_SIG);
+		}
+}
+
+/*
+ * Sample the kernel send queues of all connections and, above
+ * @budget, throttle the endpoints whose backlog (data read from them
+ * that is still in their relay buffer or in the other side's send
+ * queue) exceeds their fair share. See pepmem.h. Without a budget
+ * nothing is sampled: that's one ioctl per socket under the SYN table
+ * lock.
+ */
+static void memory_budget(size_t budget)
+{
+		struct pep_proxy *proxy;
+		struct pep_endpoint *endp, *peer;
+		uint64_t queued = 0, used, share = 0, backlog;
+		int i, outq, open = 0, throttled = 0, changed = 0, throttle;
+
+		if (!budget) {
+				if (throttled_endpoints || pepmem_read(PEPMEM_QUEUED)) {
+						memory_unthrottle();
+				}
+				return;
+		}
+
+		SYNTAB_LOCK_READ();
+		syntab_foreach_connection(proxy) {
+				if (proxy->status != PST_OPEN) {
+						continue;
+				}
+				for (i = 0; i < PROXY_ENDPOINTS; i++) {
+						endp = &proxy->endpoints[i];
+						if (ioctl(endp->fd, SIOCOUTQ, &outq) == 0 && outq > 0) {
+								endp->queued = outq;
+								queued += outq;
+						}
+						else {
+								endp->queued = 0;
+						}
+				}
+				open++;
+		}
+		pepmem_set(PEPMEM_QUEUED, queued);
+
+		used = pepmem_used();
+		if (open) {
+				share = budget / open;
+		}
+		syntab_foreach_connection(proxy) {
+				if (proxy->status != PST_OPEN) {
+						continue;
+				}
+				for (i = 0; i < PROXY_ENDPOINTS; i++) {
+						endp = &proxy->endpoints[i];
+						peer = &proxy->endpoints[!i];
+						backlog = PEPBUF_SPACE_FILLED(&endp->buf) + peer->queued;
+						if (endp->throttled) {
+								throttle = used > budget - budget / 8 && backlog > share / 2;
+						}
+						else {
+								throttle = used > budget && backlog > share;
+								if (throttle) {
+										pepstat_inc(PEPSTAT_THROTTLED);
+								}
+						}
+						if (throttle != endp->throttled) {
+								endp->throttled = throttle;
+								changed = 1;
+						}
+						throttled += throttle;
+				}
+		}
+		SYNTAB_UNLOCK_READ();
+
+		throttled_endpoints = throttled;
+		if (changed && pthread_kill(poller, POLLER_NEWCONN_SIG) != 0) {
+				pep_warning("Failed to send %d signal to poller thread",
+								POLLER_NEWCONN_SIG);
+		}
+}
+
+/*
+ * Shrink the socket buffers of the connections that give up memory at
+ * the current pressure level, restore the others.
+ */
+static void sockbuf_pressure(void)
+{
+		struct pep_proxy *proxy;
+		struct pep_endpoint *endp;
+		time_t now = time(NULL);
+		int i, shrink, size, shrunk = 0;
+
+		SYNTAB_LOCK_READ();
+		syntab_foreach_connection(proxy) {
+				if (proxy->status != PST_OPEN) {
+						continue;
+				}
+
+				shrink = should_shrink(proxy, pressure_level, now);
+				size = proxy->config->sockbuf.min ? proxy->config->sockbuf.min :
+						PEPSOCKBUF_MIN;
+				for (i = 0; i < PROXY_ENDPOINTS; i++) {
+						endp = &proxy->endpoints[i];
+						if (shrink && !endp->shrunk &&
+										pepsockbuf_shrink(endp->fd, size, endp->sockbuf_saved) == 0) {
+								endp->shrunk = 1;
+								pepstat_inc(PEPSTAT_PRESSURE_SHRINKS);
+						}
+						else if (!shrink && endp->shrunk) {
+								pepsockbuf_restore(endp->fd, endp->sockbuf_saved);
+								endp->shrunk = 0;
+								pepstat_inc(PEPSTAT_PRESSURE_RESTORES);
+						}
+						shrunk += endp->shrunk;
+				}
+		}
+		SYNTAB_UNLOCK_READ();
+		shrunk_sockets = shrunk;
+}
+
+/* Sample the memory pressure and give buffers up or back accordingly */
+static void memory_pressure(struct pep_config *cfg)
+{
+		static const char *names[] = { "none", "some", "high" };
+		struct peppressure_sample sample;
+		int prev = pressure_level;
+
+		if (!cfg->pressure) {
+				pthread_mutex_lock(&pressure_lock);
+				pressure.level = PEPPRESSURE_NONE;
+				pthread_mutex_unlock(&pressure_lock);
+				__atomic_store_n(&pressure_level, PEPPRESSURE_NONE, __ATOMIC_RELAXED);
+				if (shrunk_sockets || shrunk_relays) {
+						goto apply;
+				}
+				return;
+		}
+
+		peppressure_sample(&sample, prev);
+		pthread_mutex_lock(&pressure_lock);
+		pressure = sample;
+		pthread_mutex_unlock(&pressure_lock);
+		__atomic_store_n(&pressure_level, sample.level, __ATOMIC_RELAXED);
+		if (sample.level != prev) {
+				syslog((sample.level > prev) ? LOG_WARNING : LOG_NOTICE,
+								"memory pressure %s (psi some %.2f full %.2f, tcp_mem %"
+								PRIu64 "/%" PRIu64 " pages)", names[sample.level],
+								sample.psi_some, sample.psi_full,
+								sample.tcp_mem, sample.tcp_mem_pressure);
+		}
+		if (sample.level == PEPPRESSURE_NONE && prev == PEPPRESSURE_NONE &&
+						!shrunk_sockets && !shrunk_relays) {
+				return;
+		}
+
+apply:
+		sockbuf_pressure();
+		relay_check_requested = 1;
+		if (pthread_kill(poller, POLLER_NEWCONN_SIG) != 0) {
+				pep_warning("Failed to send %d signal to poller thread",
+								POLLER_NEWCONN_SIG);
+		}
+}
+
 static void *timer_sch_loop(void __attribute__((unused)) *unused)
 {
 		struct timeval last_log_evt_time = {0U, 0U}, last_gc_evt_time = {0U, 0U}, now;
+		struct pep_config *cfg;
+		char err[PEP_ERRBUF_SZ];
 
+		pepstat_thread_init("timer");
 		if (logger.filename) {
 				PEP_DEBUG("Setting up PEP logger");
 
@@ -1140,26 +2330,324 @@ static void *timer_sch_loop(void __attribute__((unused)) *unused)
 				}
 				gettimeofday(&last_log_evt_time, 0);
 				gettimeofday(&last_gc_evt_time, 0);
+				logger.last_dump = last_log_evt_time.tv_sec;
 		}
 
 		for(;;) {
+				if (flightrec_requested) {
+						flightrec_requested = 0;
+						flightrec_dump("signal");
+				}
+
+				if (reload_requested) {
+						reload_requested = 0;
+						if (reload_config(err, sizeof(err)) < 0) {
+								pep_warning("Reload failed, keeping the configuration: %s", err);
+						}
+				}
+
+				cfg = pepconfig_get();
 				gettimeofday(&now, 0);
-				if (logger.filename && now.tv_sec > last_log_evt_time.tv_sec + PEPLOGGER_INTERVAL) {
+				if (logger.filename && now.tv_sec > last_log_evt_time.tv_sec + cfg->log_interval) {
 						logger_fn();
 						gettimeofday(&last_log_evt_time, 0);
 				}
 
-				if (now.tv_sec > last_gc_evt_time.tv_sec + gcc_interval) {
-						garbage_connections_collector();
+				if (now.tv_sec > last_gc_evt_time.tv_sec + cfg->gcc_interval) {
+						garbage_connections_collector(cfg->pending_conn_lifetime);
 						gettimeofday(&last_gc_evt_time, 0);
 				}
-				sleep(2);
+
+				if (cfg->sockbuf_auto) {
+						sockbuf_resize();
+				}
+				memory_budget(cfg->mem_budget);
+				memory_pressure(cfg);
+				pepconfig_put(cfg);
+				sleep(1);
 		}
 }
 
+static void ctl_stats(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		struct pep_config *cfg = pepconfig_get();
+		struct peppressure_sample sample;
+
+		fprintf(out, "{\"uptime\":%.f,\"proxies\":%d,\"memory\":",
+						difftime(time(NULL), start_time), GET_SYNTAB()->num_items);
+		pepmem_dump_json(out, cfg->mem_budget, throttled_endpoints);
+		pepconfig_put(cfg);
+		fprintf(out, ",\"pressure\":");
+		pthread_mutex_lock(&pressure_lock);
+		sample = pressure;
+		pthread_mutex_unlock(&pressure_lock);
+		peppressure_dump_json(out, &sample);
+		fprintf(out, ",\"shrunk\":{\"sockets\":%d,\"relay\":%d},\"counters\":",
+						shrunk_sockets, shrunk_relays);
+		pepstat_dump_json(out);
+		fprintf(out, "}");
+}
+
+static void ctl_threads(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		int i, n = 0;
+
+		fprintf(out, "{\"workers\":%d,\"queues\":{\"active\":%d,\"ready\":%d},"
+						"\"threads\":[", PEPPOOL_THREADS,
+						active_queue.num_items, ready_queue.num_items);
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				if (pepstat_threads[i].used) {
+						fprintf(out, "%s\"%s\"", n++ ? "," : "", pepstat_threads[i].name);
+				}
+		}
+		fprintf(out, "]}");
+}
+
+static void ctl_table(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		struct syntab_stats st;
+
+		SYNTAB_LOCK_READ();
+		syntab_get_stats(&st);
+		SYNTAB_UNLOCK_READ();
+
+		fprintf(out, "{\"entries\":%u,\"max_conns\":%d,\"buckets\":%u,"
+						"\"used_buckets\":%u,\"load_factor\":%.3f,\"longest_chain\":%u}",
+						st.entries, max_conns, st.buckets, st.used_buckets,
+						st.load_factor, st.longest_chain);
+}
+
+/* Parse "a.b.c.d:port" into host order address and port */
+static int parse_ipport(const char *str, int *addr, unsigned short *port)
+{
+		char buf[32], *colon;
+		struct in_addr in;
+
+		strncpy(buf, str, sizeof(buf) - 1);
+		buf[sizeof(buf) - 1] = '\0';
+		colon = strchr(buf, ':');
+		if (!colon) {
+				return -1;
+		}
+
+		*colon = '\0';
+		if (inet_pton(AF_INET, buf, &in) != 1) {
+				return -1;
+		}
+
+		*addr = ntohl(in.s_addr);
+		*port = atoi(colon + 1);
+		return 0;
+}
+
+static void ctl_conn(FILE *out, int argc, char *argv[])
+{
+		struct pep_proxy *proxy;
+		struct syntab_key key;
+		int src_addr, dst_addr = 0;
+		unsigned short src_port, dst_port = 0;
+
+		if (argc < 2 || parse_ipport(argv[1], &src_addr, &src_port) < 0 ||
+						(argc > 2 && parse_ipport(argv[2], &dst_addr, &dst_port) < 0)) {
+				fprintf(out, "{\"error\":\"usage: conn SRC_IP:PORT [DST_IP:PORT]\"}");
+				return;
+		}
+
+		memset(&key, 0, sizeof(key));
+		key.addr = src_addr;
+		key.port = src_port;
+
+		SYNTAB_LOCK_READ();
+		proxy = syntab_find(&key);
+		if (proxy && argc > 2 &&
+						(proxy->dst.addr != dst_addr || proxy->dst.port != dst_port)) {
+				proxy = NULL;
+		}
+
+		if (proxy) {
+				dump_proxy(out, proxy, time(NULL), 0);
+		}
+		else {
+				fprintf(out, "{\"error\":\"not found\"}");
+		}
+		SYNTAB_UNLOCK_READ();
+}
+
+#define CTL_TOP_MAX 100
+
+static void ctl_top(FILE *out, int argc, char *argv[])
+{
+		struct {
+				int src_addr, dst_addr;
+				unsigned short src_port, dst_port;
+				uint64_t bytes;
+				double rate;
+		} top[CTL_TOP_MAX], cur;
+		struct pep_proxy *proxy;
+		char ip_src[17], ip_dst[17];
+		int i, n = 0, max = 10;
+		time_t tm;
+		double age;
+
+		if (argc > 1) {
+				max = atoi(argv[1]);
+		}
+		if (max <= 0 || max > CTL_TOP_MAX) {
+				max = CTL_TOP_MAX;
+		}
+
+		/* Only copy what we need under the lock, format afterwards */
+		SYNTAB_LOCK_READ();
+		tm = time(NULL);
+		syntab_foreach_connection(proxy) {
+				if (proxy->status != PST_OPEN) {
+						continue;
+				}
+
+				age = difftime(tm, proxy->syn_time);
+				cur.bytes = proxy->src.stats.bytes_in + proxy->dst.stats.bytes_in;
+				cur.rate = cur.bytes / (age > 1 ? age : 1);
+				if (n == max && cur.rate <= top[n - 1].rate) {
+						continue;
+				}
+
+				cur.src_addr = proxy->src.addr;
+				cur.src_port = proxy->src.port;
+				cur.dst_addr = proxy->dst.addr;
+				cur.dst_port = proxy->dst.port;
+				i = (n < max) ? n++ : n - 1;
+				for (; i > 0 && top[i - 1].rate < cur.rate; i--) {
+						top[i] = top[i - 1];
+				}
+				top[i] = cur;
+		}
+		SYNTAB_UNLOCK_READ();
+
+		fprintf(out, "{\"top\":[");
+		for (i = 0; i < n; i++) {
+				toip(ip_src, top[i].src_addr);
+				toip(ip_dst, top[i].dst_addr);
+				fprintf(out, "%s{\"src\":\"%s:%d\",\"dst\":\"%s:%d\","
+								"\"bytes\":%" PRIu64 ",\"rate\":%.f}", i ? "," : "",
+								ip_src, top[i].src_port, ip_dst, top[i].dst_port,
+								top[i].bytes, top[i].rate);
+		}
+		fprintf(out, "]}");
+}
+
+static void ctl_latency(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		fprintf(out, "{\"latency_ns\":");
+		pephist_dump_json(out, NULL);
+		fprintf(out, "}");
+}
+
+static void ctl_flightrec(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		int n;
+
+		n = flightrec_dump("control command");
+		fprintf(out, "{\"events\":%d,\"file\":\"%s\"}", n,
+						flightrec_path ? flightrec_path : "stderr");
+}
+
+static void ctl_perf(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		if (!pepperf_enabled) {
+				fprintf(out, "{\"error\":\"profiling is disabled, see -P\"}");
+				return;
+		}
+
+		pepperf_dump_json(out, NULL);
+}
+
+static void ctl_policy(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		struct pep_config *cfg = pepconfig_get();
+
+		peppolicy_dump_json(out, cfg->policies);
+		pepconfig_put(cfg);
+}
+
+static void ctl_config(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		struct pep_config *cfg = pepconfig_get();
+
+		pepconfig_dump_json(out, cfg);
+		pepconfig_put(cfg);
+}
+
+static void ctl_terminals(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		peprate_dump_json(out);
+}
+
+static void ctl_groups(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		pepdrr_dump_json(out);
+}
+
+static void ctl_reload(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		char err[PEP_ERRBUF_SZ];
+
+		if (reload_config(err, sizeof(err)) < 0) {
+				fprintf(out, "{\"error\":");
+				pepctl_json_string(out, err, sizeof(err));
+				fprintf(out, "}");
+				return;
+		}
+
+		ctl_config(out, 0, NULL);
+}
+
+static void init_pep_ctl(void)
+{
+		if (pepctl_init(ctl_path) < 0) {
+				pep_error("Failed to create control socket %s!", ctl_path);
+		}
+
+		pepctl_register("stats", "global counters", ctl_stats);
+		pepctl_register("threads", "threads and queue depths", ctl_threads);
+		pepctl_register("table", "connection table statistics", ctl_table);
+		pepctl_register("conn", "conn SRC_IP:PORT [DST_IP:PORT]: show one proxy",
+						ctl_conn);
+		pepctl_register("top", "top [N]: N proxies with the highest throughput",
+						ctl_top);
+		pepctl_register("latency", "latency histograms since startup",
+						ctl_latency);
+		pepctl_register("flightrec", "dump the flight recorder", ctl_flightrec);
+		pepctl_register("perf", "hardware counters since startup", ctl_perf);
+		pepctl_register("policy", "policy rules and their hits", ctl_policy);
+		pepctl_register("config", "current configuration", ctl_config);
+		pepctl_register("reload", "reload the configuration and policy files",
+						ctl_reload);
+		pepctl_register("terminals", "rate limited clients and their buckets",
+						ctl_terminals);
+		pepctl_register("groups", "fair scheduling groups and their counters",
+						ctl_groups);
+}
+
+static void shm_gauges(struct pepshm_gauges *gauges)
+{
+		gauges->live_proxies = GET_SYNTAB()->num_items;
+		gauges->max_conns = max_conns;
+		gauges->active_queue = active_queue.num_items;
+		gauges->ready_queue = ready_queue.num_items;
+		gauges->workers = PEPPOOL_THREADS;
+}
+
 static void init_pep_threads(void)
 {
 		int ret;
+
+		if (DEBUG) {
+				ret = pthread_create(&debug_logger, NULL, peplog_loop, NULL);
+				if (ret) {
+						pep_error("Failed to create the debug logger thread! [RET = %d]",
+										ret);
+				}
+		}
 		PEP_DEBUG("Creating listener thread");
 		ret = pthread_create(&listener, NULL, listener_loop, NULL);
 		if (ret) {
@@ -1176,15 +2664,44 @@ static void init_pep_threads(void)
 		if (ret < 0) {
 				pep_error("Failed to create the timer_sch thread! [RET = %d]", ret);
 		}
+
+		if (ctl_path) {
+				init_pep_ctl();
+				PEP_DEBUG("Creating control thread");
+				ret = pthread_create(&ctl, NULL, pepctl_loop, NULL);
+				if (ret) {
+						pep_error("Failed to create the control thread! [RET = %d]", ret);
+				}
+		}
+
+		if (pepwatch_threshold_ns) {
+				PEP_DEBUG("Creating stall watchdog thread");
+				ret = pthread_create(&watchdog, NULL, pepwatch_loop, NULL);
+				if (ret) {
+						pep_error("Failed to create the watchdog thread! [RET = %d]", ret);
+				}
+		}
+
+		if (shm_name) {
+				if (pepshm_init(shm_name, shm_gauges) < 0) {
+						pep_error("Failed to create shared memory segment %s!", shm_name);
+				}
+
+				PEP_DEBUG("Creating shm statistics thread");
+				ret = pthread_create(&shm, NULL, pepshm_loop, NULL);
+				if (ret) {
+						pep_error("Failed to create the shm thread! [RET = %d]", ret);
+				}
+		}
 }
 
 static void init_pep_queues(void)
 {
 		PEP_DEBUG("Initialize PEP queue for active connections...");
-		pepqueue_init(&active_queue);
+		pepqueue_init(&active_queue, PEPLOCK_ACTIVE_QUEUE);
 
 		PEP_DEBUG("Initialize PEP queue for handled connections...");
-		pepqueue_init(&ready_queue);
+		pepqueue_init(&ready_queue, PEPLOCK_READY_QUEUE);
 }
 
 static void create_threads_pool(int num_threads)
@@ -1217,10 +2734,13 @@ unsigned int atoui(char *st) {
 int main(int argc, char *argv[])
 {
 		int c, ret, numfds;
+		char errbuf[PEP_ERRBUF_SZ];
 		void *valptr;
 		sigset_t sigset;
+		struct sigaction sa;
 
 		memset(&logger, 0, sizeof(logger));
+		start_time = time(NULL);
 		while (1) {
 				int option_index = 0;
 				static struct option long_options[] = {
@@ -1235,10 +2755,19 @@ int main(int argc, char *argv[])
 						{"gcc_interval", 1, 0, 'g'},
 						{"plifetime", 1, 0,'t'},
 						{"conns", 1, 0, 'c'},
+						{"ctlsock", 1, 0, 's'},
+						{"shm", 1, 0, 'S'},
+						{"flightrec", 1, 0, 'r'},
+						{"lockstat", 0, 0, 'L'},
+						{"stall", 1, 0, 'w'},
+						{"perf", 0, 0, 'P'},
+						{"destination", 1, 0, 'D'},
+						{"policy", 1, 0, 'x'},
+						{"config", 1, 0, 'F'},
 						{0, 0, 0, 0}
 				};
 
-				c = getopt_long(argc, argv, "dvVhfp:l:g:t:c:m:n:a:b:u:",
+				c = getopt_long(argc, argv, "dvVhfLPp:l:g:t:c:m:n:a:b:u:s:S:r:w:D:x:F:",
 								long_options, &option_index);
 				if (c == -1)
 						break;
@@ -1260,30 +2789,62 @@ int main(int argc, char *argv[])
 								portnum = atoi(optarg);
 								break;
 						case 'u':
-								ingress_mtu = atoi(optarg);
+								cmdline_config.ingress_mtu = atoi(optarg);
 								break;
 						case 'm':
-								mark_egress = atoui(optarg);
+								cmdline_config.mark_egress = atoui(optarg);
 								break;
 						case 'n':
-								mark_ingress = atoui(optarg);
+								cmdline_config.mark_ingress = atoui(optarg);
 								break;
 						case 'a':
-								strncpy(tcp_congestion_algo_egress, optarg,
-												sizeof(tcp_congestion_algo_egress)-1);
+								strncpy(cmdline_config.cc_egress, optarg,
+												sizeof(cmdline_config.cc_egress)-1);
 								break;
 						case 'b':
-								strncpy(tcp_congestion_algo_ingress, optarg,
-												sizeof(tcp_congestion_algo_ingress)-1);
+								strncpy(cmdline_config.cc_ingress, optarg,
+												sizeof(cmdline_config.cc_ingress)-1);
 								break;
 						case 'l':
 								logger.filename = optarg;
 								break;
+						case 's':
+								ctl_path = optarg;
+								break;
+						case 'S':
+								shm_name = optarg;
+								break;
+						case 'r':
+								flightrec_path = optarg;
+								break;
+						case 'x':
+								policy_path = optarg;
+								break;
+						case 'F':
+								config_path = optarg;
+								break;
+						case 'L':
+								peplock_enabled = 1;
+								break;
+						case 'P':
+								pepperf_enabled = 1;
+								break;
+						case 'D':
+								if (parse_ipport(optarg, &static_dst_addr,
+														&static_dst_port) < 0) {
+										usage(argv[0]);
+								}
+
+								static_dst = 1;
+								break;
+						case 'w':
+								pepwatch_threshold_ns = (uint64_t)atoi(optarg) * 1000000ULL;
+								break;
 						case 't':
-								pending_conn_lifetime = atoi(optarg);
+								cmdline_config.pending_conn_lifetime = atoi(optarg);
 								break;
 						case 'g':
-								gcc_interval = atoi(optarg);
+								cmdline_config.gcc_interval = atoi(optarg);
 								break;
 						case 'c':
 								max_conns = atoi(optarg);
@@ -1307,6 +2868,10 @@ int main(int argc, char *argv[])
 				}
 		}
 
+		if (reload_config(errbuf, sizeof(errbuf)) < 0) {
+				pep_error("Failed to load the configuration: %s", errbuf);
+		}
+
 		PEP_DEBUG("Init SYN table with %d max connections", max_conns);
 		ret = syntab_init(max_conns);
 		if (ret < 0) {
@@ -1332,6 +2897,18 @@ int main(int argc, char *argv[])
 		sigaddset(&sigset, SIGPIPE);
 		sigprocmask(SIG_BLOCK, &sigset, NULL);
 
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = flightrec_sighandler;
+		sa.sa_flags = SA_RESTART;
+		if (sigaction(FLIGHTREC_DUMP_SIG, &sa, NULL) < 0) {
+				pep_error("sigaction() error!");
+		}
+
+		sa.sa_handler = reload_sighandler;
+		if (sigaction(SIGHUP, &sa, NULL) < 0) {
+				pep_error("sigaction() error!");
+		}
+
 		init_pep_queues();
 		init_pep_threads();
 		create_threads_pool(PEPPOOL_THREADS);
@@ -18,21 +18,32 @@
 #include "pepsal.h"
 #include "pepbuf.h"
 
-int pepbuf_init(struct pep_buffer *pbuf)
+/*
+ * Size of a buffer allocated for @size bytes: @size rounded up to
+ * whole pages, PEPBUF_PAGES pages if @size is 0.
+ */
+size_t pepbuf_size(size_t size)
+{
+		long page_size = sysconf(_SC_PAGESIZE);
+
+		return size ? (size + page_size - 1) & ~(page_size - 1) :
+				PEPBUF_PAGES * page_size;
+}
+
+int pepbuf_init(struct pep_buffer *pbuf, size_t size)
 {
 		void *space;
-		long page_size;
 
-		page_size = sysconf(_SC_PAGESIZE);
-		space = mmap(NULL, PEPBUF_PAGES * page_size, PROT_READ | PROT_WRITE,
+		size = pepbuf_size(size);
+		space = mmap(NULL, size, PROT_READ | PROT_WRITE,
 						MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
-		if (!space) {
+		if (space == MAP_FAILED) {
 				return -1;
 		}
 
 		pbuf->space = space;
 		pbuf->r_pos = pbuf->w_pos = pbuf->space;
-		pbuf->total_size = PEPBUF_PAGES * page_size;
+		pbuf->total_size = size;
 		pbuf->space_left = pbuf->total_size;
 		pbuf->rbytes = 0;
 
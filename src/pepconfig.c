@@ -0,0 +1,244 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "pepconfig.h"
+#include "pepmem.h"
+#include "pepctl.h"
+
+#define PEPCONFIG_LINE_SZ     1024
+#define PEPCONFIG_MAX_RELAY   (64 * 1024 * 1024)
+
+/*
+ * The lock only covers reading the pointer and taking a reference, or
+ * swapping the pointer: a few instructions, taken once per accepted
+ * connection and never by the poller or the workers.
+ */
+static pthread_mutex_t pepconfig_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pep_config *pepconfig_current = NULL;
+static unsigned int pepconfig_generation = 0;
+
+static int parse_int(const char *str, long max, long *val)
+{
+		char *end;
+
+		errno = 0;
+		*val = strtol(str, &end, 0);
+		if (!*str || *end || errno || *val < 0 || *val > max) {
+				return -1;
+		}
+
+		return 0;
+}
+
+/* Apply "key=value" to @cfg, returns -1 if it's not a valid setting */
+static int parse_setting(struct pep_config *cfg, char *key, char *value)
+{
+		long val;
+
+		if (!strcmp(key, "cc_egress") || !strcmp(key, "cc_ingress")) {
+				if (strlen(value) >= PEPPOLICY_CC_SZ) {
+						return -1;
+				}
+				strcpy((key[3] == 'e') ? cfg->cc_egress : cfg->cc_ingress, value);
+				return 0;
+		}
+
+		if (parse_int(value, INT32_MAX, &val) < 0) {
+				return -1;
+		}
+		if (!strcmp(key, "gcc_interval") && val > 0) {
+				cfg->gcc_interval = val;
+		}
+		else if (!strcmp(key, "plifetime") && val > 0) {
+				cfg->pending_conn_lifetime = val;
+		}
+		else if (!strcmp(key, "log_interval") && val > 0) {
+				cfg->log_interval = val;
+		}
+		else if (!strcmp(key, "mark_egress")) {
+				cfg->mark_egress = val;
+		}
+		else if (!strcmp(key, "mark_ingress")) {
+				cfg->mark_ingress = val;
+		}
+		else if (!strcmp(key, "mtu_ingress") && (!val || (val > 80 && val <= 65535))) {
+				cfg->ingress_mtu = val;
+		}
+		else if (!strcmp(key, "relay_buf") && val <= PEPCONFIG_MAX_RELAY) {
+				cfg->relay_buf = val;
+		}
+		else if (!strcmp(key, "link_rate")) {
+				cfg->link_rate = val;
+		}
+		else if (!strcmp(key, "link_rtt")) {
+				cfg->link_rtt = val;
+		}
+		else if (!strcmp(key, "pacing_rate")) {
+				cfg->pacing_rate = val;
+		}
+		else if (!strcmp(key, "terminal_rate")) {
+				cfg->terminal_rate = val;
+		}
+		else if (!strcmp(key, "terminal_burst")) {
+				cfg->terminal_burst = val;
+		}
+		else if (!strcmp(key, "drr_quantum")) {
+				cfg->drr_quantum = val;
+		}
+		else if (!strcmp(key, "drr_prefix") && val <= 32) {
+				cfg->drr_prefix = val;
+		}
+		else if (!strcmp(key, "sockbuf_auto") && val <= 1) {
+				cfg->sockbuf_auto = val;
+		}
+		else if (!strcmp(key, "sockbuf_min")) {
+				cfg->sockbuf.min = val;
+		}
+		else if (!strcmp(key, "sockbuf_max") && val > 0) {
+				cfg->sockbuf.max = val;
+		}
+		else if (!strcmp(key, "sockbuf_budget")) {
+				cfg->sockbuf.budget = val;
+		}
+		else if (!strcmp(key, "mem_budget")) {
+				cfg->mem_budget = val;
+		}
+		else if (!strcmp(key, "pressure") && val <= 1) {
+				cfg->pressure = val;
+		}
+		else {
+				return -1;
+		}
+
+		return 0;
+}
+
+/*
+ * Apply the settings of the configuration file @path to @cfg.
+ * On error, returns -1 and describes the problem in @err.
+ */
+int pepconfig_parse(struct pep_config *cfg, const char *path, char *err,
+				size_t errlen)
+{
+		char line[PEPCONFIG_LINE_SZ], *key, *value, *end;
+		int lineno = 0;
+		FILE *f;
+
+		f = fopen(path, "r");
+		if (!f) {
+				snprintf(err, errlen, "%s: %s", path, strerror(errno));
+				return -1;
+		}
+
+		while (fgets(line, sizeof(line), f)) {
+				lineno++;
+				for (key = line; isspace(*key); key++);
+				for (end = key + strlen(key); end > key && isspace(end[-1]); end--);
+				*end = '\0';
+				if (!*key || *key == '#') {
+						continue;
+				}
+
+				value = strchr(key, '=');
+				if (value) {
+						*value++ = '\0';
+				}
+				if (!value || parse_setting(cfg, key, value) < 0) {
+						snprintf(err, errlen, "%s:%d: invalid setting \"%s\"",
+										path, lineno, key);
+						fclose(f);
+						errno = EINVAL;
+						return -1;
+				}
+		}
+
+		fclose(f);
+		if (cfg->sockbuf.min > cfg->sockbuf.max) {
+				snprintf(err, errlen, "%s: sockbuf_min is above sockbuf_max", path);
+				errno = EINVAL;
+				return -1;
+		}
+
+		return 0;
+}
+
+/*
+ * Make @cfg, which must hold one reference, the current configuration.
+ * The reference of the previous one is dropped.
+ */
+void pepconfig_publish(struct pep_config *cfg)
+{
+		struct pep_config *old;
+
+		cfg->loaded = time(NULL);
+		pthread_mutex_lock(&pepconfig_lock);
+		cfg->generation = ++pepconfig_generation;
+		old = pepconfig_current;
+		pepconfig_current = cfg;
+		pthread_mutex_unlock(&pepconfig_lock);
+
+		if (old) {
+				pepconfig_put(old);
+		}
+}
+
+/* Returns the current configuration with a reference held */
+struct pep_config *pepconfig_get(void)
+{
+		struct pep_config *cfg;
+
+		pthread_mutex_lock(&pepconfig_lock);
+		cfg = pepconfig_current;
+		atomic_inc(&cfg->refcnt);
+		pthread_mutex_unlock(&pepconfig_lock);
+
+		return cfg;
+}
+
+void pepconfig_put(struct pep_config *cfg)
+{
+		if (atomic_dec(&cfg->refcnt) == 1) {
+				peppolicy_free(cfg->policies);
+				free(cfg);
+		}
+}
+
+void pepconfig_dump_json(FILE *file, struct pep_config *cfg)
+{
+		fprintf(file, "{\"generation\":%u,\"loaded\":%ld,\"refs\":%d,"
+						"\"gcc_interval\":%d,\"plifetime\":%d,\"log_interval\":%d,"
+						"\"cc_egress\":", cfg->generation, (long)cfg->loaded,
+						atomic_read(&cfg->refcnt), cfg->gcc_interval,
+						cfg->pending_conn_lifetime, cfg->log_interval);
+		pepctl_json_string(file, cfg->cc_egress, PEPPOLICY_CC_SZ);
+		fprintf(file, ",\"cc_ingress\":");
+		pepctl_json_string(file, cfg->cc_ingress, PEPPOLICY_CC_SZ);
+		fprintf(file, ",\"mark_egress\":%u,\"mark_ingress\":%u,\"mtu_ingress\":%d,"
+						"\"relay_buf\":%zu,\"mem_budget\":%zu,\"pressure\":%d,"
+						"\"link_rate\":%u,\"link_rtt\":%u,\"pacing_rate\":%u,"
+						"\"terminal_rate\":%u,\"terminal_burst\":%u,"
+						"\"drr_quantum\":%zu,\"drr_prefix\":%d,"
+						"\"sockbuf\":{\"auto\":%d,\"min\":%zu,\"max\":%zu,"
+						"\"budget\":%zu,\"used\":%" PRIu64 "},\"policy_rules\":%u}",
+						cfg->mark_egress, cfg->mark_ingress, cfg->ingress_mtu,
+						cfg->relay_buf, cfg->mem_budget, cfg->pressure,
+						cfg->link_rate, cfg->link_rtt, cfg->pacing_rate,
+						cfg->terminal_rate, cfg->terminal_burst, cfg->drr_quantum,
+						cfg->drr_prefix, cfg->sockbuf_auto,
+						cfg->sockbuf.min, cfg->sockbuf.max, cfg->sockbuf.budget,
+						pepmem_read(PEPMEM_SOCKBUF),
+						cfg->policies ? cfg->policies->nr_rules : 0);
+}
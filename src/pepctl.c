@@ -0,0 +1,235 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+/*
+ * Local control socket. A client connects to the UNIX socket, sends
+ * one command per connection as a text line, for example:
+ *
+ *     echo "top 10" | socat - UNIX-CONNECT:/run/pepsal.sock
+ *
+ * and receives a single line of JSON before the socket is closed.
+ * Requests are served one at a time by a dedicated thread, so a slow
+ * or stuck client never delays the poller or the workers.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#include "pepctl.h"
+#include "pepstat.h"
+
+struct pepctl_command {
+		const char *name;
+		const char *help;
+		pepctl_handler_t handler;
+};
+
+static struct pepctl_command pepctl_commands[PEPCTL_MAX_COMMANDS];
+static int pepctl_nr_commands = 0;
+static int pepctl_fd = -1;
+
+int pepctl_register(const char *name, const char *help,
+				pepctl_handler_t handler)
+{
+		struct pepctl_command *cmd;
+
+		if (pepctl_nr_commands >= PEPCTL_MAX_COMMANDS) {
+				errno = ENOSPC;
+				return -1;
+		}
+
+		cmd = &pepctl_commands[pepctl_nr_commands++];
+		cmd->name = name;
+		cmd->help = help;
+		cmd->handler = handler;
+		return 0;
+}
+
+static void pepctl_help(FILE *out, int UNUSED(argc), char UNUSED(*argv[]))
+{
+		int i;
+
+		fprintf(out, "{\"commands\":{");
+		for (i = 0; i < pepctl_nr_commands; i++) {
+				fprintf(out, "%s\"%s\":\"%s\"", i ? "," : "",
+								pepctl_commands[i].name, pepctl_commands[i].help);
+		}
+		fprintf(out, "}}");
+}
+
+/*
+ * Create the control socket bound to @path. A stale socket left by
+ * a previous instance is removed.
+ */
+int pepctl_init(const char *path)
+{
+		struct sockaddr_un addr;
+		int fd;
+
+		if (strlen(path) >= sizeof(addr.sun_path)) {
+				errno = ENAMETOOLONG;
+				return -1;
+		}
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+				return -1;
+		}
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, path);
+		unlink(path);
+		if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+						chmod(path, S_IRUSR | S_IWUSR) < 0 ||
+						listen(fd, 16) < 0) {
+				close(fd);
+				return -1;
+		}
+
+		pepctl_register("help", "list available commands", pepctl_help);
+		pepctl_fd = fd;
+		return 0;
+}
+
+static int pepctl_read_request(int fd, char *buf, size_t size)
+{
+		size_t len = 0;
+		ssize_t rb;
+		char *eol;
+
+		while (len < size - 1) {
+				rb = read(fd, buf + len, size - 1 - len);
+				if (rb <= 0) {
+						break;
+				}
+
+				len += rb;
+				buf[len] = '\0';
+				eol = strchr(buf, '\n');
+				if (eol) {
+						*eol = '\0';
+						return 0;
+				}
+		}
+
+		buf[len] = '\0';
+		return len ? 0 : -1;
+}
+
+static void pepctl_dispatch(FILE *out, char *request)
+{
+		char *argv[PEPCTL_MAX_ARGS], *saveptr = NULL, *word;
+		int argc = 0, i;
+
+		for (word = strtok_r(request, " \t\r", &saveptr);
+						word && argc < PEPCTL_MAX_ARGS;
+						word = strtok_r(NULL, " \t\r", &saveptr)) {
+				argv[argc++] = word;
+		}
+
+		if (!argc) {
+				fprintf(out, "{\"error\":\"empty request\"}");
+				return;
+		}
+
+		for (i = 0; i < pepctl_nr_commands; i++) {
+				if (strcmp(pepctl_commands[i].name, argv[0]) == 0) {
+						pepctl_commands[i].handler(out, argc, argv);
+						return;
+				}
+		}
+
+		fprintf(out, "{\"error\":\"unknown command\",\"command\":");
+		pepctl_json_string(out, argv[0], 32);
+		fprintf(out, "}");
+}
+
+/*
+ * Write at most @max bytes of @str to @out as a quoted JSON string,
+ * escaping quotes, backslashes and control characters.
+ */
+void pepctl_json_string(FILE *out, const char *str, size_t max)
+{
+		const unsigned char *c;
+
+		fputc('"', out);
+		for (c = (const unsigned char *)str; *c && max; c++, max--) {
+				if (*c == '"' || *c == '\\') {
+						fprintf(out, "\\%c", *c);
+				}
+				else if (*c < 0x20) {
+						fprintf(out, "\\u%04x", *c);
+				}
+				else {
+						fputc(*c, out);
+				}
+		}
+		fputc('"', out);
+}
+
+static void pepctl_serve(int fd)
+{
+		struct timeval t = { 1, 0 };
+		char request[PEPCTL_REQUEST_SZ];
+		char *reply = NULL;
+		size_t reply_len = 0, off;
+		ssize_t wb;
+		FILE *out;
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &t, sizeof(t));
+		if (pepctl_read_request(fd, request, sizeof(request)) < 0) {
+				return;
+		}
+
+		out = open_memstream(&reply, &reply_len);
+		if (!out) {
+				return;
+		}
+
+		pepctl_dispatch(out, request);
+		fprintf(out, "\n");
+		fclose(out);
+
+		for (off = 0; off < reply_len; off += wb) {
+				wb = write(fd, reply + off, reply_len - off);
+				if (wb <= 0) {
+						break;
+				}
+		}
+
+		free(reply);
+}
+
+void *pepctl_loop(void UNUSED(*unused))
+{
+		int fd;
+
+		pepstat_thread_init("ctl");
+		for (;;) {
+				fd = accept(pepctl_fd, NULL, NULL);
+				if (fd < 0) {
+						continue;
+				}
+
+				pepctl_serve(fd);
+				close(fd);
+		}
+
+		return NULL;
+}
@@ -0,0 +1,138 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "pepdrr.h"
+
+static struct pepreg pepdrr_groups = PEPREG_INITIALIZER;
+
+struct pepdrr_args {
+		uint32_t prefix;
+		unsigned int len;
+		size_t quantum;
+};
+
+static void setup_group(struct pepreg_entry *entry, int created, void *arg)
+{
+		struct pepdrr_group *group = (struct pepdrr_group *)entry;
+		struct pepdrr_args *args = arg;
+
+		if (created) {
+				group->prefix = args->prefix;
+				group->len = args->len;
+		}
+		group->quantum = args->quantum;
+}
+
+/*
+ * Join the group of @addr with a @len bits prefix, creating it if
+ * needed. The group's quantum becomes @quantum, so after a reload the
+ * quantum of a group is the one of its most recently accepted
+ * connection. Returns NULL if the group could not be allocated, the
+ * connection is then not scheduled.
+ */
+struct pepdrr_group *pepdrr_get(uint32_t addr, unsigned int len, size_t quantum)
+{
+		struct pepdrr_args args = {
+				.prefix = len ? addr & (0xffffffffU << (32 - len)) : 0,
+				.len = len,
+				.quantum = quantum,
+		};
+
+		return (struct pepdrr_group *)pepreg_get(&pepdrr_groups,
+						((uint64_t)len << 32) | args.prefix,
+						sizeof(struct pepdrr_group), setup_group, &args);
+}
+
+/* Leave @group, freeing it with its last connection */
+void pepdrr_put(struct pepdrr_group *group)
+{
+		if (pepreg_put(&pepdrr_groups, &group->entry)) {
+				free(group);
+		}
+}
+
+/*
+ * A connection of @group is ready in @round. The first one of a round
+ * earns the group its quantum, after dropping the deficit left from
+ * the previous round unless the group was backlogged in it.
+ */
+void pepdrr_ready(struct pepdrr_group *group, uint64_t round)
+{
+		if (group->round != round) {
+				if (group->round + 1 != round || !group->backlogged) {
+						group->deficit = 0;
+				}
+				group->deficit += group->quantum;
+				group->round = round;
+				group->ready = 0;
+				group->backlogged = 0;
+				group->rounds++;
+		}
+		group->ready++;
+}
+
+/* Bytes each ready connection of @group may write in this round */
+size_t pepdrr_share(struct pepdrr_group *group)
+{
+		size_t share = 0;
+
+		if (group->deficit > 0) {
+				share = group->deficit / group->ready;
+		}
+
+		return (share < PEPDRR_MIN_SHARE) ? PEPDRR_MIN_SHARE : share;
+}
+
+/*
+ * A connection of @group wrote @bytes in this round, @limited if it
+ * stopped because it had used its share.
+ */
+void pepdrr_charge(struct pepdrr_group *group, size_t bytes, int limited)
+{
+		group->deficit -= bytes;
+		group->bytes += bytes;
+		if (limited) {
+				group->backlogged = 1;
+				group->limited++;
+		}
+}
+
+struct pepdrr_dump {
+		FILE *file;
+		int first;
+};
+
+static void dump_group(struct pepreg_entry *entry, int UNUSED(created), void *arg)
+{
+		struct pepdrr_group *group = (struct pepdrr_group *)entry;
+		struct pepdrr_dump *dump = arg;
+
+		fprintf(dump->file, "%s{\"prefix\":\"%u.%u.%u.%u/%u\",\"quantum\":%zu"
+						",\"deficit\":%" PRId64 ",\"bytes\":%" PRIu64
+						",\"rounds\":%" PRIu64 ",\"limited\":%" PRIu64
+						",\"conns\":%d}", dump->first ? "" : ",",
+						group->prefix >> 24, (group->prefix >> 16) & 0xff,
+						(group->prefix >> 8) & 0xff, group->prefix & 0xff,
+						group->len, group->quantum, group->deficit,
+						group->bytes, group->rounds, group->limited,
+						group->entry.refcnt);
+		dump->first = 0;
+}
+
+void pepdrr_dump_json(FILE *file)
+{
+		struct pepdrr_dump dump = { file, 1 };
+
+		fprintf(file, "[");
+		pepreg_foreach(&pepdrr_groups, dump_group, &dump);
+		fprintf(file, "]");
+}
@@ -0,0 +1,73 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "peplock.h"
+
+int peplock_enabled = 0;
+struct peplock_thread peplock_threads[PEPSTAT_MAX_THREADS];
+
+static const char *peplock_names[PEPLOCK_NR] = {
+		[PEPLOCK_SYNTAB_READ]  = "syntab_read",
+		[PEPLOCK_SYNTAB_WRITE] = "syntab_write",
+		[PEPLOCK_ACTIVE_QUEUE] = "active_queue",
+		[PEPLOCK_READY_QUEUE]  = "ready_queue",
+};
+
+void peplock_merge(enum peplock_id id, struct peplock_totals *totals)
+{
+		struct peplock_stats *st;
+		int i, j;
+
+		memset(totals, 0, sizeof(*totals));
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				if (!pepstat_threads[i].used) {
+						continue;
+				}
+
+				st = &peplock_threads[i].stats[id];
+				totals->acquired += st->acquired;
+				totals->contended += st->contended;
+				for (j = 0; j < PEPHIST_BUCKETS; j++) {
+						totals->wait.buckets[j] += st->wait[j];
+						totals->hold.buckets[j] += st->hold[j];
+				}
+		}
+}
+
+/*
+ * Print statistics of all instrumented locks as a JSON object.
+ * If @prev is not NULL, only the activity since the previous call
+ * is printed and @prev is updated.
+ */
+void peplock_dump_json(FILE *file, struct peplock_totals *prev)
+{
+		struct peplock_totals totals;
+		int id;
+
+		fprintf(file, "{");
+		for (id = 0; id < PEPLOCK_NR; id++) {
+				peplock_merge(id, &totals);
+				fprintf(file, "%s\"%s\":{\"acquired\":%" PRIu64
+								",\"contended\":%" PRIu64 ",\"wait_ns\":",
+								id ? "," : "", peplock_names[id],
+								totals.acquired - (prev ? prev[id].acquired : 0),
+								totals.contended - (prev ? prev[id].contended : 0));
+				pephist_print_json(file, &totals.wait, prev ? &prev[id].wait : NULL);
+				fprintf(file, ",\"hold_ns\":");
+				pephist_print_json(file, &totals.hold, prev ? &prev[id].hold : NULL);
+				fprintf(file, "}");
+				if (prev) {
+						prev[id] = totals;
+				}
+		}
+		fprintf(file, "}");
+}
@@ -0,0 +1,234 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "peplog.h"
+#include "pepstat.h"
+
+/*
+ * Every ring is a bounded queue in the fashion of D. Vyukov's one:
+ * each record carries a sequence number telling whether it's free
+ * for the producer at a given position or ready for the consumer.
+ * Producers reserve positions with a CAS on head, so a ring stays
+ * consistent even when several threads share statistics slot 0.
+ * Records are consumed by one thread at a time (peplog_drain_lock).
+ */
+struct peplog_ring {
+		uint32_t head;
+		char pad[60];
+		uint32_t tail;
+		struct peplog_record *records;
+} __attribute__((aligned(64)));
+
+static struct peplog_ring peplog_rings[PEPSTAT_MAX_THREADS];
+static pthread_mutex_t peplog_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct peplog_record *peplog_ring_alloc(struct peplog_ring *ring)
+{
+		struct peplog_record *records, *expected = NULL;
+		int i;
+
+		records = calloc(PEPLOG_RING_SIZE, sizeof(*records));
+		if (!records) {
+				return NULL;
+		}
+
+		for (i = 0; i < PEPLOG_RING_SIZE; i++) {
+				records[i].seq = i;
+		}
+
+		if (!__atomic_compare_exchange_n(&ring->records, &expected, records,
+								0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				free(records);
+				return expected;
+		}
+
+		return records;
+}
+
+static struct peplog_record *peplog_reserve(void)
+{
+		struct peplog_ring *ring = &peplog_rings[pepstat_self - pepstat_threads];
+		struct peplog_record *records, *rec;
+		uint32_t pos;
+		int32_t diff;
+
+		records = __atomic_load_n(&ring->records, __ATOMIC_ACQUIRE);
+		if (!records) {
+				records = peplog_ring_alloc(ring);
+				if (!records) {
+						goto drop;
+				}
+		}
+
+		pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		for (;;) {
+				rec = &records[pos & (PEPLOG_RING_SIZE - 1)];
+				diff = (int32_t)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) - pos);
+				if (diff == 0) {
+						if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+												__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+								return rec;
+						}
+				}
+				else if (diff < 0) {
+						goto drop;
+				}
+				else {
+						pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+				}
+		}
+
+drop:
+		pepstat_inc(PEPSTAT_DEBUG_DROPPED);
+		return NULL;
+}
+
+static void peplog_commit(struct peplog_record *rec)
+{
+		__atomic_store_n(&rec->seq, rec->seq + 1, __ATOMIC_RELEASE);
+}
+
+void peplog_debug(const char *function, const char *fmt, ...)
+{
+		struct peplog_record *rec;
+		va_list ap;
+
+		rec = peplog_reserve();
+		if (!rec) {
+				return;
+		}
+
+		rec->ts = pep_clock_ns();
+		rec->function = function;
+		rec->has_addr = 0;
+		va_start(ap, fmt);
+		vsnprintf(rec->msg, sizeof(rec->msg), fmt, ap);
+		va_end(ap);
+		peplog_commit(rec);
+}
+
+void peplog_debug_dp(const char *function, int addr, unsigned short port,
+				const char *fmt, ...)
+{
+		struct peplog_record *rec;
+		va_list ap;
+
+		rec = peplog_reserve();
+		if (!rec) {
+				return;
+		}
+
+		rec->ts = pep_clock_ns();
+		rec->function = function;
+		rec->has_addr = 1;
+		rec->addr = addr;
+		rec->port = port;
+		va_start(ap, fmt);
+		vsnprintf(rec->msg, sizeof(rec->msg), fmt, ap);
+		va_end(ap);
+		peplog_commit(rec);
+}
+
+uint64_t peplog_dropped(void)
+{
+		return pepstat_read(PEPSTAT_DEBUG_DROPPED);
+}
+
+static void peplog_output(struct peplog_record *rec)
+{
+		char ipbuf[INET_ADDRSTRLEN];
+		struct in_addr in;
+
+		if (!rec->has_addr) {
+				fprintf(stderr, "[DEBUG] %s(): %s\n", rec->function, rec->msg);
+				syslog(LOG_DEBUG, "%s(): %s", rec->function, rec->msg);
+				return;
+		}
+
+		in.s_addr = htonl(rec->addr);
+		inet_ntop(AF_INET, &in, ipbuf, sizeof(ipbuf));
+		fprintf(stderr, "[DEBUG] %s(): {%s:%d} %s\n", rec->function,
+						ipbuf, rec->port, rec->msg);
+		syslog(LOG_DEBUG, "%s(): {%s:%d} %s", rec->function,
+						ipbuf, rec->port, rec->msg);
+}
+
+/* Output all pending records, returns the number of records handled */
+static int peplog_drain(void)
+{
+		static uint64_t reported_drops = 0;
+		struct peplog_ring *ring;
+		struct peplog_record *records, *rec;
+		uint64_t drops;
+		int i, n = 0;
+
+		pthread_mutex_lock(&peplog_drain_lock);
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				ring = &peplog_rings[i];
+				records = __atomic_load_n(&ring->records, __ATOMIC_ACQUIRE);
+				if (!records) {
+						continue;
+				}
+
+				for (;;) {
+						rec = &records[ring->tail & (PEPLOG_RING_SIZE - 1)];
+						if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != ring->tail + 1) {
+								break;
+						}
+
+						peplog_output(rec);
+						__atomic_store_n(&rec->seq, ring->tail + PEPLOG_RING_SIZE,
+										__ATOMIC_RELEASE);
+						ring->tail++;
+						n++;
+				}
+		}
+
+		drops = peplog_dropped();
+		if (drops != reported_drops) {
+				fprintf(stderr, "[DEBUG] %llu debug records dropped\n",
+								(unsigned long long)(drops - reported_drops));
+				syslog(LOG_DEBUG, "%llu debug records dropped",
+								(unsigned long long)(drops - reported_drops));
+				reported_drops = drops;
+		}
+		pthread_mutex_unlock(&peplog_drain_lock);
+
+		return n;
+}
+
+/* Synchronously output pending records, e.g. before exiting */
+void peplog_flush(void)
+{
+		peplog_drain();
+		fflush(stderr);
+}
+
+void *peplog_loop(void UNUSED(*unused))
+{
+		struct timespec ts = { 0, PEPLOG_DRAIN_INTERVAL_MS * 1000000L };
+
+		pepstat_thread_init("log");
+		for (;;) {
+				if (!peplog_drain()) {
+						nanosleep(&ts, NULL);
+				}
+		}
+
+		return NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <inttypes.h>
+
+#include "pepmem.h"
+
+static uint64_t pepmem_bytes[PEPMEM_NR];
+
+void pepmem_charge(enum pepmem_kind kind, int64_t bytes)
+{
+		__sync_add_and_fetch(&pepmem_bytes[kind], bytes);
+}
+
+void pepmem_set(enum pepmem_kind kind, uint64_t bytes)
+{
+		__atomic_store_n(&pepmem_bytes[kind], bytes, __ATOMIC_RELAXED);
+}
+
+uint64_t pepmem_read(enum pepmem_kind kind)
+{
+		return __atomic_load_n(&pepmem_bytes[kind], __ATOMIC_RELAXED);
+}
+
+uint64_t pepmem_used(void)
+{
+		return pepmem_read(PEPMEM_RELAY) + pepmem_read(PEPMEM_QUEUED);
+}
+
+/* Whether @bytes more fit in @budget, 0 meaning no budget */
+int pepmem_fits(size_t budget, size_t bytes)
+{
+		return !budget || pepmem_used() + bytes <= budget;
+}
+
+void pepmem_dump_json(FILE *file, size_t budget, int throttled)
+{
+		fprintf(file, "{\"budget\":%zu,\"used\":%" PRIu64 ",\"relay\":%" PRIu64
+						",\"queued\":%" PRIu64 ",\"sockbuf\":%" PRIu64
+						",\"throttled\":%d}", budget, pepmem_used(),
+						pepmem_read(PEPMEM_RELAY), pepmem_read(PEPMEM_QUEUED),
+						pepmem_read(PEPMEM_SOCKBUF), throttled);
+}
@@ -0,0 +1,186 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "pepperf.h"
+
+int pepperf_enabled = 0;
+
+static struct pepperf_thread pepperf_threads[PEPSTAT_MAX_THREADS];
+static __thread int pepperf_fd = -1;
+
+static const struct {
+		uint32_t type;
+		uint64_t config;
+} pepperf_events[PEPPERF_EVENTS] = {
+		[PEPPERF_CYCLES]       = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		[PEPPERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		[PEPPERF_LLC_MISSES]   = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static const char *pepperf_event_names[PEPPERF_EVENTS] = {
+		[PEPPERF_CYCLES]       = "cycles",
+		[PEPPERF_INSTRUCTIONS] = "instructions",
+		[PEPPERF_LLC_MISSES]   = "llc_misses",
+};
+
+static const char *pepperf_section_names[PEPPERF_NR] = {
+		[PEPPERF_PROXY_DATA]   = "proxy_data",
+		[PEPPERF_POLL_REBUILD] = "poll_rebuild",
+		[PEPPERF_ACCEPT]       = "accept",
+};
+
+/*
+ * Open the counters of the calling thread. Returns -1 and sets errno
+ * if they are not available (e.g. perf_event_paranoid or no PMU in a
+ * VM), the thread then runs without profiling.
+ */
+int pepperf_thread_init(void)
+{
+		struct perf_event_attr attr;
+		int fds[PEPPERF_EVENTS];
+		int i, group = -1;
+
+		if (!pepperf_enabled) {
+				return 0;
+		}
+
+		for (i = 0; i < PEPPERF_EVENTS; i++) {
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = pepperf_events[i].type;
+				attr.config = pepperf_events[i].config;
+				attr.read_format = PERF_FORMAT_GROUP;
+				attr.exclude_hv = 1;
+				attr.disabled = (group < 0);
+
+				fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+				if (fds[i] < 0) {
+						/* Siblings are separate fds, close them all */
+						while (i-- > 0) {
+								close(fds[i]);
+						}
+						return -1;
+				}
+				if (group < 0) {
+						group = fds[i];
+				}
+		}
+
+		ioctl(group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		pepperf_fd = group;
+		return 0;
+}
+
+void pepperf_read(struct pepperf_sample *sample)
+{
+		uint64_t buf[1 + PEPPERF_EVENTS];
+
+		if (pepperf_fd < 0 ||
+						read(pepperf_fd, buf, sizeof(buf)) != sizeof(buf)) {
+				memset(sample, 0, sizeof(*sample));
+				return;
+		}
+
+		memcpy(sample->val, &buf[1], sizeof(sample->val));
+}
+
+void pepperf_account(enum pepperf_section section,
+				struct pepperf_sample *start)
+{
+		struct pepperf_counts *counts;
+		struct pepperf_sample now;
+		int i;
+
+		if (pepperf_fd < 0) {
+				return;
+		}
+
+		pepperf_read(&now);
+		counts = &pepperf_threads[pepstat_self - pepstat_threads].sections[section];
+		counts->calls++;
+		for (i = 0; i < PEPPERF_EVENTS; i++) {
+				counts->val[i] += now.val[i] - start->val[i];
+		}
+}
+
+static void pepperf_merge(struct pepperf_totals *totals)
+{
+		int i, s, e;
+
+		memset(totals, 0, sizeof(*totals));
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				if (!pepstat_threads[i].used) {
+						continue;
+				}
+				for (s = 0; s < PEPPERF_NR; s++) {
+						totals->sections[s].calls += pepperf_threads[i].sections[s].calls;
+						for (e = 0; e < PEPPERF_EVENTS; e++) {
+								totals->sections[s].val[e] +=
+										pepperf_threads[i].sections[s].val[e];
+						}
+				}
+		}
+		totals->bytes = pepstat_read(PEPSTAT_BYTES_FROM_CLIENTS) +
+				pepstat_read(PEPSTAT_BYTES_FROM_SERVERS);
+}
+
+/*
+ * Print the counters of every section and the derived per byte and
+ * per connection costs as a JSON object. If @prev is not NULL, only
+ * the activity since the previous call is printed and @prev is updated.
+ */
+void pepperf_dump_json(FILE *file, struct pepperf_totals *prev)
+{
+		struct pepperf_totals totals, delta;
+		struct pepperf_counts *data, *accept;
+		int s, e;
+
+		pepperf_merge(&totals);
+		delta = totals;
+		if (prev) {
+				for (s = 0; s < PEPPERF_NR; s++) {
+						delta.sections[s].calls -= prev->sections[s].calls;
+						for (e = 0; e < PEPPERF_EVENTS; e++) {
+								delta.sections[s].val[e] -= prev->sections[s].val[e];
+						}
+				}
+				delta.bytes -= prev->bytes;
+				*prev = totals;
+		}
+
+		fprintf(file, "{");
+		for (s = 0; s < PEPPERF_NR; s++) {
+				fprintf(file, "\"%s\":{\"calls\":%" PRIu64, pepperf_section_names[s],
+								delta.sections[s].calls);
+				for (e = 0; e < PEPPERF_EVENTS; e++) {
+						fprintf(file, ",\"%s\":%" PRIu64, pepperf_event_names[e],
+										delta.sections[s].val[e]);
+				}
+				fprintf(file, "},");
+		}
+
+		data = &delta.sections[PEPPERF_PROXY_DATA];
+		accept = &delta.sections[PEPPERF_ACCEPT];
+		fprintf(file, "\"bytes\":%" PRIu64 ",\"cycles_per_byte\":%.3f,"
+						"\"llc_misses_per_kb\":%.3f,\"cycles_per_setup\":%.f}",
+						delta.bytes,
+						delta.bytes ? (double)data->val[PEPPERF_CYCLES] / delta.bytes : 0.0,
+						delta.bytes ? (double)data->val[PEPPERF_LLC_MISSES] * 1024 /
+								delta.bytes : 0.0,
+						accept->calls ? (double)accept->val[PEPPERF_CYCLES] /
+								accept->calls : 0.0);
+}
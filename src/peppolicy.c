@@ -0,0 +1,503 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include "peppolicy.h"
+#include "pepctl.h"
+
+#define PEPPOLICY_LINE_SZ     1024
+#define PEPPOLICY_MAX_RELAY   (64 * 1024 * 1024)
+
+static void peppolicy_err(char *err, size_t errlen, const char *path,
+				int line, const char *fmt, ...)
+{
+		va_list ap;
+		int len;
+
+		len = snprintf(err, errlen, "%s:%d: ", path, line);
+		if (len < 0 || (size_t)len >= errlen) {
+				return;
+		}
+
+		va_start(ap, fmt);
+		vsnprintf(err + len, errlen - len, fmt, ap);
+		va_end(ap);
+}
+
+/* Parse "a.b.c.d/len", "a.b.c.d" or "*" into host byte order */
+static int parse_cidr(const char *str, uint32_t *addr, unsigned char *len)
+{
+		char buf[INET_ADDRSTRLEN + 4], *slash, *end;
+		struct in_addr in;
+		unsigned long plen = 32;
+
+		if (!strcmp(str, "*")) {
+				*addr = 0;
+				*len = 0;
+				return 0;
+		}
+		if (strlen(str) >= sizeof(buf)) {
+				return -1;
+		}
+
+		strcpy(buf, str);
+		slash = strchr(buf, '/');
+		if (slash) {
+				*slash++ = '\0';
+				plen = strtoul(slash, &end, 10);
+				if (!*slash || *end || plen > 32) {
+						return -1;
+				}
+		}
+		if (inet_pton(AF_INET, buf, &in) != 1) {
+				return -1;
+		}
+
+		*addr = ntohl(in.s_addr);
+		if (plen < 32) {
+				*addr &= plen ? ~0U << (32 - plen) : 0;
+		}
+		*len = plen;
+		return 0;
+}
+
+static int parse_uint(const char *str, unsigned long max, unsigned long *val)
+{
+		char *end;
+
+		errno = 0;
+		*val = strtoul(str, &end, 0);
+		if (!*str || *end || errno || *val > max || *str == '-') {
+				return -1;
+		}
+
+		return 0;
+}
+
+/* Apply "key=value" to @rule, returns -1 if it's not a valid setting */
+static int parse_setting(struct pep_policy *rule, char *setting)
+{
+		char *value = strchr(setting, '=');
+		unsigned long val;
+
+		if (!value) {
+				return -1;
+		}
+		*value++ = '\0';
+
+		if (!strcmp(setting, "name")) {
+				if (strlen(value) >= sizeof(rule->name)) {
+						return -1;
+				}
+				strcpy(rule->name, value);
+		}
+		else if (!strcmp(setting, "cc_egress") || !strcmp(setting, "cc_ingress")) {
+				if (!*value || strlen(value) >= PEPPOLICY_CC_SZ) {
+						return -1;
+				}
+				strcpy((setting[3] == 'e') ? rule->cc_egress : rule->cc_ingress,
+								value);
+		}
+		else if (!strcmp(setting, "mark_egress") ||
+						!strcmp(setting, "mark_ingress")) {
+				if (parse_uint(value, UINT32_MAX, &val) < 0) {
+						return -1;
+				}
+				*((setting[5] == 'e') ? &rule->mark_egress : &rule->mark_ingress) = val;
+		}
+		else if (!strcmp(setting, "mtu_ingress")) {
+				if (parse_uint(value, 65535, &val) < 0 || val <= 80) {
+						return -1;
+				}
+				rule->mtu_ingress = val;
+		}
+		else if (!strcmp(setting, "sndbuf") || !strcmp(setting, "rcvbuf")) {
+				if (parse_uint(value, INT32_MAX / 2, &val) < 0 || !val) {
+						return -1;
+				}
+				*((setting[0] == 's') ? &rule->sndbuf : &rule->rcvbuf) = val;
+		}
+		else if (!strcmp(setting, "link_rate") || !strcmp(setting, "link_rtt")) {
+				if (parse_uint(value, UINT32_MAX, &val) < 0 || !val) {
+						return -1;
+				}
+				*(!strcmp(setting, "link_rate") ? &rule->link_rate : &rule->link_rtt) = val;
+		}
+		else if (!strcmp(setting, "pacing_rate")) {
+				if (parse_uint(value, UINT32_MAX, &val) < 0 || !val) {
+						return -1;
+				}
+				rule->pacing_rate = val;
+		}
+		else if (!strcmp(setting, "terminal_rate") ||
+						!strcmp(setting, "terminal_burst")) {
+				if (parse_uint(value, UINT32_MAX, &val) < 0 || !val) {
+						return -1;
+				}
+				*(!strcmp(setting, "terminal_rate") ? &rule->terminal_rate :
+								&rule->terminal_burst) = val;
+		}
+		else if (!strcmp(setting, "priority")) {
+				if (!strcmp(value, "low")) {
+						rule->priority = PEPPOLICY_PRIO_LOW;
+				}
+				else if (!strcmp(value, "normal")) {
+						rule->priority = PEPPOLICY_PRIO_NORMAL;
+				}
+				else if (!strcmp(value, "high")) {
+						rule->priority = PEPPOLICY_PRIO_HIGH;
+				}
+				else {
+						return -1;
+				}
+		}
+		else if (!strcmp(setting, "relay_buf")) {
+				if (parse_uint(value, PEPPOLICY_MAX_RELAY, &val) < 0 || !val) {
+						return -1;
+				}
+				rule->relay_buf = val;
+		}
+		else {
+				return -1;
+		}
+
+		return 0;
+}
+
+/* Returns the index of a new empty node, -1 if out of memory */
+static int node_alloc(struct peppolicy_table *table)
+{
+		struct peppolicy_node *nodes;
+
+		if (table->nr_nodes == table->max_nodes) {
+				nodes = realloc(table->nodes,
+								2 * table->max_nodes * sizeof(*nodes));
+				if (!nodes) {
+						return -1;
+				}
+				table->nodes = nodes;
+				table->max_nodes *= 2;
+		}
+
+		table->nodes[table->nr_nodes].child[0] = 0;
+		table->nodes[table->nr_nodes].child[1] = 0;
+		table->nodes[table->nr_nodes].value = -1;
+		return table->nr_nodes++;
+}
+
+/* Index of the node for the first @len bits of @addr below @node */
+static int trie_walk(struct peppolicy_table *table, int node,
+				uint32_t addr, unsigned char len)
+{
+		unsigned char depth;
+		int bit, child;
+
+		for (depth = 0; depth < len; depth++) {
+				bit = (addr >> (31 - depth)) & 1;
+				child = table->nodes[node].child[bit];
+				if (!child) {
+						child = node_alloc(table);
+						if (child < 0) {
+								return -1;
+						}
+						table->nodes[node].child[bit] = child;
+				}
+				node = child;
+		}
+
+		return node;
+}
+
+static int peppolicy_insert(struct peppolicy_table *table, int idx)
+{
+		struct pep_policy *rule = &table->rules[idx];
+		int node, root;
+
+		node = trie_walk(table, 0, rule->src, rule->src_len);
+		if (node < 0) {
+				return -1;
+		}
+		if (table->nodes[node].value < 0) {
+				root = node_alloc(table);
+				if (root < 0) {
+						return -1;
+				}
+				table->nodes[node].value = root;
+		}
+
+		node = trie_walk(table, table->nodes[node].value, rule->dst,
+						rule->dst_len);
+		if (node < 0) {
+				return -1;
+		}
+		if (table->nodes[node].value >= 0) {
+				errno = EEXIST;
+				return -1;
+		}
+
+		table->nodes[node].value = idx;
+		return 0;
+}
+
+static struct peppolicy_table *peppolicy_alloc(void)
+{
+		struct peppolicy_table *table;
+
+		table = calloc(1, sizeof(*table));
+		if (!table) {
+				return NULL;
+		}
+
+		table->max_nodes = 64;
+		table->nodes = malloc(table->max_nodes * sizeof(*table->nodes));
+		if (!table->nodes) {
+				free(table);
+				return NULL;
+		}
+
+		node_alloc(table);
+		return table;
+}
+
+/*
+ * Load the rules of policy file @path. On failure returns NULL, sets
+ * errno and puts a message saying what's wrong where into @err.
+ */
+struct peppolicy_table *peppolicy_load(const char *path, char *err,
+				size_t errlen)
+{
+		struct peppolicy_table *table;
+		struct pep_policy *rules, *rule;
+		char line[PEPPOLICY_LINE_SZ], *word, *saveptr;
+		unsigned int max_rules = 0;
+		int lineno = 0, ret;
+		FILE *f;
+
+		f = fopen(path, "r");
+		if (!f) {
+				peppolicy_err(err, errlen, path, 0, "%s", strerror(errno));
+				return NULL;
+		}
+
+		table = peppolicy_alloc();
+		if (!table) {
+				goto err_nomem;
+		}
+
+		while (fgets(line, sizeof(line), f)) {
+				lineno++;
+				line[strcspn(line, "#\n")] = '\0';
+				word = strtok_r(line, " \t", &saveptr);
+				if (!word) {
+						continue;
+				}
+
+				if (table->nr_rules == max_rules) {
+						max_rules = max_rules ? max_rules * 2 : 16;
+						rules = realloc(table->rules, max_rules * sizeof(*rules));
+						if (!rules) {
+								goto err_nomem;
+						}
+						table->rules = rules;
+				}
+
+				rule = &table->rules[table->nr_rules];
+				memset(rule, 0, sizeof(*rule));
+				rule->line = lineno;
+				if (parse_cidr(word, &rule->src, &rule->src_len) < 0) {
+						peppolicy_err(err, errlen, path, lineno,
+										"invalid source \"%s\"", word);
+						goto err_inval;
+				}
+
+				word = strtok_r(NULL, " \t", &saveptr);
+				if (!word || parse_cidr(word, &rule->dst, &rule->dst_len) < 0) {
+						peppolicy_err(err, errlen, path, lineno,
+										"invalid destination \"%s\"", word ? word : "");
+						goto err_inval;
+				}
+
+				while ((word = strtok_r(NULL, " \t", &saveptr))) {
+						if (parse_setting(rule, word) < 0) {
+								peppolicy_err(err, errlen, path, lineno,
+												"invalid setting \"%s\"", word);
+								goto err_inval;
+						}
+				}
+				if (!rule->name[0]) {
+						snprintf(rule->name, sizeof(rule->name), "line%d", lineno);
+				}
+
+				ret = peppolicy_insert(table, table->nr_rules);
+				if (ret < 0 && errno == EEXIST) {
+						peppolicy_err(err, errlen, path, lineno,
+										"same source and destination as an earlier rule");
+						goto err_inval;
+				}
+				if (ret < 0) {
+						goto err_nomem;
+				}
+				table->nr_rules++;
+		}
+
+		fclose(f);
+		return table;
+
+err_nomem:
+		peppolicy_err(err, errlen, path, lineno, "out of memory");
+		errno = ENOMEM;
+		goto err;
+err_inval:
+		errno = EINVAL;
+err:
+		ret = errno;
+		fclose(f);
+		peppolicy_free(table);
+		errno = ret;
+		return NULL;
+}
+
+void peppolicy_free(struct peppolicy_table *table)
+{
+		if (!table) {
+				return;
+		}
+
+		free(table->nodes);
+		free(table->rules);
+		free(table);
+}
+
+/* Longest prefix match of @addr in the trie rooted at @node */
+static int trie_lookup(struct peppolicy_table *table, uint32_t node,
+				uint32_t addr, int32_t *path)
+{
+		int depth = 0, found = 0;
+
+		for (;;) {
+				if (table->nodes[node].value >= 0) {
+						path[found++] = table->nodes[node].value;
+				}
+				if (depth == 32) {
+						break;
+				}
+
+				node = table->nodes[node].child[(addr >> (31 - depth)) & 1];
+				if (!node) {
+						break;
+				}
+				depth++;
+		}
+
+		return found;
+}
+
+/*
+ * Rule for a connection from @src to @dst (host byte order), NULL if
+ * none matches. Lock free: the table is never modified once loaded.
+ */
+struct pep_policy *peppolicy_lookup(struct peppolicy_table *table,
+				uint32_t src, uint32_t dst)
+{
+		int32_t srcs[33], dsts[33];
+		struct pep_policy *rule;
+		int nsrc, ndst;
+
+		if (!table || !table->nr_rules) {
+				return NULL;
+		}
+
+		nsrc = trie_lookup(table, 0, src, srcs);
+		while (nsrc-- > 0) {
+				ndst = trie_lookup(table, srcs[nsrc], dst, dsts);
+				if (ndst) {
+						rule = &table->rules[dsts[ndst - 1]];
+						__sync_fetch_and_add(&rule->hits, 1);
+						return rule;
+				}
+		}
+
+		return NULL;
+}
+
+static void print_cidr(FILE *file, uint32_t addr, unsigned char len)
+{
+		fprintf(file, "\"%u.%u.%u.%u/%u\"", addr >> 24, (addr >> 16) & 0xff,
+						(addr >> 8) & 0xff, addr & 0xff, len);
+}
+
+void peppolicy_dump_json(FILE *file, struct peppolicy_table *table)
+{
+		struct pep_policy *rule;
+		unsigned int i;
+
+		fprintf(file, "{\"rules\":[");
+		for (i = 0; table && i < table->nr_rules; i++) {
+				rule = &table->rules[i];
+				fprintf(file, "%s{\"name\":", i ? "," : "");
+				pepctl_json_string(file, rule->name, sizeof(rule->name));
+				fprintf(file, ",\"line\":%d,\"src\":", rule->line);
+				print_cidr(file, rule->src, rule->src_len);
+				fprintf(file, ",\"dst\":");
+				print_cidr(file, rule->dst, rule->dst_len);
+				if (rule->cc_egress[0]) {
+						fprintf(file, ",\"cc_egress\":");
+						pepctl_json_string(file, rule->cc_egress, PEPPOLICY_CC_SZ);
+				}
+				if (rule->cc_ingress[0]) {
+						fprintf(file, ",\"cc_ingress\":");
+						pepctl_json_string(file, rule->cc_ingress, PEPPOLICY_CC_SZ);
+				}
+				if (rule->mark_egress) {
+						fprintf(file, ",\"mark_egress\":%u", rule->mark_egress);
+				}
+				if (rule->mark_ingress) {
+						fprintf(file, ",\"mark_ingress\":%u", rule->mark_ingress);
+				}
+				if (rule->mtu_ingress) {
+						fprintf(file, ",\"mtu_ingress\":%d", rule->mtu_ingress);
+				}
+				if (rule->sndbuf) {
+						fprintf(file, ",\"sndbuf\":%d", rule->sndbuf);
+				}
+				if (rule->rcvbuf) {
+						fprintf(file, ",\"rcvbuf\":%d", rule->rcvbuf);
+				}
+				if (rule->relay_buf) {
+						fprintf(file, ",\"relay_buf\":%zu", rule->relay_buf);
+				}
+				if (rule->priority != PEPPOLICY_PRIO_NORMAL) {
+						fprintf(file, ",\"priority\":\"%s\"",
+										(rule->priority < 0) ? "low" : "high");
+				}
+				if (rule->link_rate) {
+						fprintf(file, ",\"link_rate\":%u", rule->link_rate);
+				}
+				if (rule->link_rtt) {
+						fprintf(file, ",\"link_rtt\":%u", rule->link_rtt);
+				}
+				if (rule->pacing_rate) {
+						fprintf(file, ",\"pacing_rate\":%u", rule->pacing_rate);
+				}
+				if (rule->terminal_rate) {
+						fprintf(file, ",\"terminal_rate\":%u", rule->terminal_rate);
+				}
+				if (rule->terminal_burst) {
+						fprintf(file, ",\"terminal_burst\":%u", rule->terminal_burst);
+				}
+				fprintf(file, ",\"hits\":%" PRIu64 "}", rule->hits);
+		}
+		fprintf(file, "],\"nodes\":%u}", table ? table->nr_nodes : 0);
+}
@@ -0,0 +1,133 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "peppressure.h"
+
+#define PSI_PATH      "/proc/pressure/memory"
+#define SOCKSTAT_PATH "/proc/net/sockstat"
+#define TCP_MEM_PATH  "/proc/sys/net/ipv4/tcp_mem"
+
+static void read_psi(struct peppressure_sample *sample)
+{
+		char line[256];
+		double avg10;
+		FILE *f;
+
+		sample->psi_some = sample->psi_full = -1;
+		f = fopen(PSI_PATH, "r");
+		if (!f) {
+				return;
+		}
+
+		while (fgets(line, sizeof(line), f)) {
+				if (sscanf(line, "some avg10=%lf", &avg10) == 1) {
+						sample->psi_some = avg10;
+				}
+				else if (sscanf(line, "full avg10=%lf", &avg10) == 1) {
+						sample->psi_full = avg10;
+				}
+		}
+		fclose(f);
+}
+
+static int read_tcp_mem(struct peppressure_sample *sample)
+{
+		char line[256], *mem;
+		int ret = -1;
+		FILE *f;
+
+		f = fopen(TCP_MEM_PATH, "r");
+		if (!f) {
+				return -1;
+		}
+		if (fscanf(f, "%" SCNu64 " %" SCNu64 " %" SCNu64, &sample->tcp_mem_min,
+								&sample->tcp_mem_pressure, &sample->tcp_mem_max) != 3) {
+				fclose(f);
+				return -1;
+		}
+		fclose(f);
+
+		f = fopen(SOCKSTAT_PATH, "r");
+		if (!f) {
+				return -1;
+		}
+		while (fgets(line, sizeof(line), f)) {
+				if (strncmp(line, "TCP:", 4) || !(mem = strstr(line, " mem "))) {
+						continue;
+				}
+				if (sscanf(mem, " mem %" SCNu64, &sample->tcp_mem) == 1) {
+						ret = 0;
+				}
+		}
+		fclose(f);
+
+		return ret;
+}
+
+/* Level of @sample with the thresholds scaled to @percent */
+static int level_of(const struct peppressure_sample *sample, double percent)
+{
+		double tcp = 0;
+
+		if (sample->tcp_mem_pressure) {
+				tcp = 100.0 * sample->tcp_mem / sample->tcp_mem_pressure;
+		}
+
+		if (sample->psi_some >= PEPPRESSURE_PSI_HIGH * percent / 100 ||
+						sample->psi_full >= PEPPRESSURE_PSI_FULL_HIGH * percent / 100 ||
+						tcp >= PEPPRESSURE_TCP_HIGH * percent / 100) {
+				return PEPPRESSURE_HIGH;
+		}
+		if (sample->psi_some >= PEPPRESSURE_PSI_SOME * percent / 100 ||
+						tcp >= PEPPRESSURE_TCP_SOME * percent / 100) {
+				return PEPPRESSURE_SOME;
+		}
+
+		return PEPPRESSURE_NONE;
+}
+
+/*
+ * Take a new sample and compute its level, @prev_level being the level
+ * of the previous one. Returns -1 if neither PSI nor the TCP memory
+ * could be read.
+ */
+int peppressure_sample(struct peppressure_sample *sample, int prev_level)
+{
+		int enter, stay;
+
+		memset(sample, 0, sizeof(*sample));
+		read_psi(sample);
+		if (read_tcp_mem(sample) < 0 && sample->psi_some < 0) {
+				sample->level = PEPPRESSURE_NONE;
+				return -1;
+		}
+
+		enter = level_of(sample, 100);
+		stay = level_of(sample, PEPPRESSURE_EXIT_PERCENT);
+		if (stay > prev_level) {
+				stay = prev_level;
+		}
+		sample->level = (enter > stay) ? enter : stay;
+
+		return 0;
+}
+
+void peppressure_dump_json(FILE *file, const struct peppressure_sample *sample)
+{
+		static const char *names[] = { "none", "some", "high" };
+
+		fprintf(file, "{\"level\":\"%s\",\"psi_some\":%.2f,\"psi_full\":%.2f,"
+						"\"tcp_mem\":%" PRIu64 ",\"tcp_mem_pressure\":%" PRIu64
+						",\"tcp_mem_max\":%" PRIu64 "}", names[sample->level],
+						sample->psi_some, sample->psi_full, sample->tcp_mem,
+						sample->tcp_mem_pressure, sample->tcp_mem_max);
+}
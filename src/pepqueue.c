@@ -13,8 +13,9 @@
 
 #include "pepsal.h"
 #include "pepqueue.h"
+#include "peptrace.h"
 
-int pepqueue_init(struct pep_queue *pq)
+int pepqueue_init(struct pep_queue *pq, enum peplock_id lock_id)
 {
 		list_init_head(&pq->queue);
 		if (pthread_mutex_init(&pq->mutex, NULL) != 0) {
@@ -25,6 +26,7 @@ int pepqueue_init(struct pep_queue *pq)
 		}
 
 		pq->num_items = 0;
+		pq->lock_id = lock_id;
 		return 0;
 }
 
@@ -32,6 +34,7 @@ void pepqueue_enqueue(struct pep_queue *pq, struct pep_proxy *proxy)
 {
 		list_add2tail(&pq->queue, &proxy->qnode);
 		pq->num_items++;
+		PEP_TRACE3(enqueue, pq, 1, pq->num_items);
 }
 
 void pepqueue_enqueue_list(struct pep_queue *pq,
@@ -39,6 +42,7 @@ void pepqueue_enqueue_list(struct pep_queue *pq,
 {
 		list_move2tail(&pq->queue, list);
 		pq->num_items += num_items;
+		PEP_TRACE3(enqueue, pq, num_items, pq->num_items);
 }
 
 struct pep_proxy *pepqueue_dequeue(struct pep_queue *pq)
@@ -53,12 +57,14 @@ struct pep_proxy *pepqueue_dequeue(struct pep_queue *pq)
 						struct pep_proxy, qnode);
 		list_del(&proxy->qnode);
 		pq->num_items--;
+		PEP_TRACE3(dequeue, pq, proxy, pq->num_items);
 
 		return proxy;
 }
 
 void pepqueue_dequeue_list(struct pep_queue *pq, struct list_head *lh)
 {
+		PEP_TRACE3(dequeue, pq, NULL, pq->num_items);
 		list_move2head(lh, &pq->queue);
 		pq->num_items = 0;
 }
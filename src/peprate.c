@@ -0,0 +1,232 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+
+#include "peprate.h"
+#include "pepstat.h"
+
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+
+#define NSEC_PER_SEC    1000000000ULL
+
+/* Buckets by client address */
+static struct pepreg peprate_buckets = PEPREG_INITIALIZER;
+
+static uint64_t default_burst(uint64_t rate, uint64_t burst)
+{
+		if (!burst) {
+				burst = rate * PEPRATE_BURST_MS / 1000;
+		}
+
+		return (burst < PEPRATE_MIN_BURST) ? PEPRATE_MIN_BURST : burst;
+}
+
+struct peprate_args {
+		uint32_t addr;
+		uint64_t rate;
+		uint64_t burst;
+};
+
+static void setup_bucket(struct pepreg_entry *entry, int created, void *arg)
+{
+		struct peprate_bucket *bucket = (struct peprate_bucket *)entry;
+		struct peprate_args *args = arg;
+
+		if (created) {
+				bucket->addr = args->addr;
+				bucket->rate = args->rate;
+				bucket->burst = bucket->tokens = args->burst;
+				bucket->stamp = pep_clock_ns();
+				bucket->conns = 1;
+				pthread_mutex_init(&bucket->lock, NULL);
+				return;
+		}
+
+		pthread_mutex_lock(&bucket->lock);
+		bucket->conns++;
+		bucket->rate = args->rate;
+		bucket->burst = args->burst;
+		if (bucket->tokens > bucket->burst) {
+				bucket->tokens = bucket->burst;
+		}
+		pthread_mutex_unlock(&bucket->lock);
+}
+
+/*
+ * Take a reference to the bucket of client @addr. A new bucket starts
+ * full. An existing one takes @rate (bytes/s) and @burst (bytes, 0 for
+ * the default) as its new limits, so that a reload applies to clients
+ * as soon as they open a new connection. Returns NULL if the bucket
+ * could not be allocated, the connection is then not limited.
+ */
+struct peprate_bucket *peprate_get(uint32_t addr, uint64_t rate, uint64_t burst)
+{
+		struct peprate_args args = {
+				.addr = addr,
+				.rate = rate,
+				.burst = default_burst(rate, burst),
+		};
+
+		return (struct peprate_bucket *)pepreg_get(&peprate_buckets, addr,
+						sizeof(struct peprate_bucket), setup_bucket, &args);
+}
+
+/* Drop a connection's reference, freeing the bucket with the last one */
+void peprate_put(struct peprate_bucket *bucket)
+{
+		pthread_mutex_lock(&bucket->lock);
+		bucket->conns--;
+		pthread_mutex_unlock(&bucket->lock);
+
+		if (pepreg_put(&peprate_buckets, &bucket->entry)) {
+				pthread_mutex_destroy(&bucket->lock);
+				free(bucket);
+		}
+}
+
+/* Add the tokens earned since the last refill, keeping the remainder */
+static void refill(struct peprate_bucket *bucket, uint64_t now)
+{
+		uint64_t elapsed, tokens;
+
+		if (now <= bucket->stamp) {
+				return;
+		}
+
+		elapsed = now - bucket->stamp;
+		if (elapsed >= NSEC_PER_SEC) {
+				tokens = bucket->rate;
+		}
+		else {
+				tokens = elapsed * bucket->rate / NSEC_PER_SEC;
+		}
+		if (bucket->tokens + tokens >= bucket->burst) {
+				bucket->tokens = bucket->burst;
+				bucket->stamp = now;
+		}
+		else {
+				bucket->tokens += tokens;
+				bucket->stamp += tokens * NSEC_PER_SEC / bucket->rate;
+		}
+}
+
+/* Most bytes a connection of @bucket is granted at once */
+static uint64_t share(struct peprate_bucket *bucket)
+{
+		uint64_t share = bucket->burst / (bucket->conns ? bucket->conns : 1);
+
+		if (share < PEPRATE_MIN_SHARE) {
+				share = PEPRATE_MIN_SHARE;
+		}
+
+		return (share > bucket->burst) ? bucket->burst : share;
+}
+
+/*
+ * Take up to @want bytes worth of tokens at @now, @queued if the caller
+ * waited for its slot. Returns the bytes granted; 0 if the caller has
+ * to wait, @wait being then set to the nanoseconds until its slot.
+ */
+size_t peprate_take(struct peprate_bucket *bucket, size_t want, uint64_t now,
+				int queued, uint64_t *wait)
+{
+		uint64_t need = (want < PEPRATE_MIN_GRANT) ? want : PEPRATE_MIN_GRANT;
+		uint64_t max, lag, start;
+		size_t granted = 0;
+
+		pthread_mutex_lock(&bucket->lock);
+		refill(bucket, now);
+		max = share(bucket);
+		if ((queued || bucket->slot <= now) && bucket->tokens >= need) {
+				granted = (want < bucket->tokens) ? want : bucket->tokens;
+				if (granted > max) {
+						granted = max;
+				}
+				bucket->tokens -= granted;
+				bucket->bytes += granted;
+		}
+		else {
+				/*
+				 * Slot for what @want is short of, after the last one
+				 * handed out. With none pending, count the tokens left as
+				 * already earned towards it.
+				 */
+				start = bucket->slot;
+				if (start <= now) {
+						lag = bucket->tokens * NSEC_PER_SEC / bucket->rate;
+						start = (now > lag) ? now - lag : 0;
+				}
+				if (want < max) {
+						max = want;
+				}
+				bucket->slot = start + max * NSEC_PER_SEC / bucket->rate + 1;
+				*wait = bucket->slot - now;
+				bucket->deferred++;
+		}
+		pthread_mutex_unlock(&bucket->lock);
+
+		return granted;
+}
+
+/* Give back tokens taken for bytes that could not be written */
+void peprate_refund(struct peprate_bucket *bucket, size_t bytes)
+{
+		pthread_mutex_lock(&bucket->lock);
+		bucket->tokens += bytes;
+		if (bucket->tokens > bucket->burst) {
+				bucket->tokens = bucket->burst;
+		}
+		bucket->bytes -= bytes;
+		pthread_mutex_unlock(&bucket->lock);
+}
+
+/* Cap the pacing rate of @fd to @rate bytes/s */
+int peprate_pacing(int fd, uint64_t rate)
+{
+		unsigned int val = (rate < UINT32_MAX) ? rate : UINT32_MAX - 1;
+
+		return setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &val, sizeof(val));
+}
+
+struct peprate_dump {
+		FILE *file;
+		int first;
+};
+
+static void dump_bucket(struct pepreg_entry *entry, int UNUSED(created), void *arg)
+{
+		struct peprate_bucket *bucket = (struct peprate_bucket *)entry;
+		struct peprate_dump *dump = arg;
+
+		pthread_mutex_lock(&bucket->lock);
+		fprintf(dump->file, "%s{\"addr\":\"%u.%u.%u.%u\",\"rate\":%" PRIu64
+						",\"burst\":%" PRIu64 ",\"tokens\":%" PRIu64
+						",\"bytes\":%" PRIu64 ",\"deferred\":%" PRIu64
+						",\"conns\":%d}", dump->first ? "" : ",",
+						bucket->addr >> 24, (bucket->addr >> 16) & 0xff,
+						(bucket->addr >> 8) & 0xff, bucket->addr & 0xff,
+						bucket->rate, bucket->burst, bucket->tokens,
+						bucket->bytes, bucket->deferred, bucket->entry.refcnt);
+		pthread_mutex_unlock(&bucket->lock);
+		dump->first = 0;
+}
+
+void peprate_dump_json(FILE *file)
+{
+		struct peprate_dump dump = { file, 1 };
+
+		fprintf(file, "[");
+		pepreg_foreach(&peprate_buckets, dump_bucket, &dump);
+		fprintf(file, "]");
+}
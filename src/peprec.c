@@ -0,0 +1,126 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "peprec.h"
+
+struct peprec_ring peprec_rings[PEPSTAT_MAX_THREADS];
+
+static const char *peprec_names[PEPREC_NR] = {
+		[PEPREC_NONE]       = "none",
+		[PEPREC_ACCEPT]     = "accept",
+		[PEPREC_SYNTAB_ADD] = "syntab_add",
+		[PEPREC_SYNTAB_DEL] = "syntab_del",
+		[PEPREC_CONNECT]    = "connect",
+		[PEPREC_CONNECTED]  = "connected",
+		[PEPREC_RECV]       = "recv",
+		[PEPREC_SEND]       = "send",
+		[PEPREC_IOERR]      = "ioerr",
+		[PEPREC_EXPIRED]    = "expired",
+		[PEPREC_DESTROY]    = "destroy",
+};
+
+static const char *peprec_status[] = {
+		"CLOSED", "OPEN", "CONNECT", "PENDING", "INVAL",
+};
+
+struct peprec_entry {
+		struct peprec_event ev;
+		int thread;
+};
+
+static int peprec_cmp(const void *a, const void *b)
+{
+		const struct peprec_entry *ea = a, *eb = b;
+
+		if (ea->ev.ts == eb->ev.ts) {
+				return 0;
+		}
+
+		return (ea->ev.ts < eb->ev.ts) ? -1 : 1;
+}
+
+static void peprec_toip(char *buf, uint32_t addr)
+{
+		struct in_addr in;
+
+		in.s_addr = htonl(addr);
+		inet_ntop(AF_INET, &in, buf, INET_ADDRSTRLEN);
+}
+
+/*
+ * Write all recorded events to @file in chronological order.
+ * Rings keep being written while they are dumped, so the most recent
+ * events of busy threads may be missing or inconsistent.
+ * Returns the number of dumped events or -1 on failure.
+ */
+int peprec_dump(FILE *file, const char *reason)
+{
+		struct peprec_entry *entries;
+		struct peprec_event *ev;
+		struct timespec mono, real;
+		char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+		int64_t offset;
+		uint64_t wall;
+		int i, j, n = 0;
+
+		entries = malloc(sizeof(*entries) * PEPSTAT_MAX_THREADS * PEPREC_RING_SIZE);
+		if (!entries) {
+				return -1;
+		}
+
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				if (!pepstat_threads[i].used) {
+						continue;
+				}
+				for (j = 0; j < PEPREC_RING_SIZE; j++) {
+						if (peprec_rings[i].events[j].type == PEPREC_NONE) {
+								continue;
+						}
+
+						entries[n].ev = peprec_rings[i].events[j];
+						entries[n].thread = i;
+						n++;
+				}
+		}
+
+		qsort(entries, n, sizeof(*entries), peprec_cmp);
+
+		/* Events are stamped with the monotonic clock, convert them */
+		clock_gettime(CLOCK_MONOTONIC, &mono);
+		clock_gettime(CLOCK_REALTIME, &real);
+		offset = ((int64_t)real.tv_sec - mono.tv_sec) * 1000000000LL +
+				(real.tv_nsec - mono.tv_nsec);
+
+		fprintf(file, "=== pepsal flight recorder: %d events, reason: %s ===\n",
+						n, reason);
+		for (i = 0; i < n; i++) {
+				ev = &entries[i].ev;
+				wall = ev->ts + offset;
+				peprec_toip(src, ev->src_addr);
+				peprec_toip(dst, ev->dst_addr);
+				fprintf(file, "%llu.%06llu %-8s %-10s %s:%u -> %s:%u %s err=%d arg=%d\n",
+								(unsigned long long)(wall / 1000000000ULL),
+								(unsigned long long)(wall % 1000000000ULL) / 1000,
+								pepstat_threads[entries[i].thread].name,
+								(ev->type < PEPREC_NR) ? peprec_names[ev->type] : "?",
+								src, ev->src_port, dst, ev->dst_port,
+								(ev->status <= PST_INVAL) ? peprec_status[ev->status] : "?",
+								ev->err, ev->arg);
+		}
+		fprintf(file, "=== end of flight recorder dump ===\n");
+		fflush(file);
+
+		free(entries);
+		return n;
+}
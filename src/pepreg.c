@@ -0,0 +1,98 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <stdlib.h>
+
+#include "pepreg.h"
+
+static unsigned int hash_key(uint64_t key)
+{
+		key ^= key >> 32;
+		return (key ^ (key >> 8) ^ (key >> 16) ^ (key >> 24)) % PEPREG_HASH_SZ;
+}
+
+/*
+ * Take a reference to the entry of @key, allocating @size bytes for it
+ * if there is none. @setup, if any, initializes a new entry or updates
+ * an existing one before anybody else can see it. Returns NULL if out
+ * of memory.
+ */
+struct pepreg_entry *pepreg_get(struct pepreg *reg, uint64_t key, size_t size,
+				pepreg_fn_t setup, void *arg)
+{
+		struct pepreg_entry *entry;
+		unsigned int h = hash_key(key);
+		int created = 0;
+
+		pthread_mutex_lock(&reg->lock);
+		for (entry = reg->table[h]; entry; entry = entry->next) {
+				if (entry->key == key) {
+						break;
+				}
+		}
+
+		if (!entry) {
+				entry = calloc(1, size);
+				if (!entry) {
+						goto out;
+				}
+				entry->key = key;
+				entry->next = reg->table[h];
+				reg->table[h] = entry;
+				created = 1;
+		}
+		entry->refcnt++;
+		if (setup) {
+				setup(entry, created, arg);
+		}
+
+out:
+		pthread_mutex_unlock(&reg->lock);
+		return entry;
+}
+
+/*
+ * Drop a reference to @entry. Returns 1 if it was the last one: the
+ * entry is then unlinked and the caller frees it.
+ */
+int pepreg_put(struct pepreg *reg, struct pepreg_entry *entry)
+{
+		struct pepreg_entry **pp;
+
+		pthread_mutex_lock(&reg->lock);
+		if (--entry->refcnt > 0) {
+				pthread_mutex_unlock(&reg->lock);
+				return 0;
+		}
+
+		for (pp = &reg->table[hash_key(entry->key)]; *pp; pp = &(*pp)->next) {
+				if (*pp == entry) {
+						*pp = entry->next;
+						break;
+				}
+		}
+		pthread_mutex_unlock(&reg->lock);
+
+		return 1;
+}
+
+/* Call @fn for every entry of @reg, under the registry lock */
+void pepreg_foreach(struct pepreg *reg, pepreg_fn_t fn, void *arg)
+{
+		struct pepreg_entry *entry;
+		int i;
+
+		pthread_mutex_lock(&reg->lock);
+		for (i = 0; i < PEPREG_HASH_SZ; i++) {
+				for (entry = reg->table[i]; entry; entry = entry->next) {
+						fn(entry, 0, arg);
+				}
+		}
+		pthread_mutex_unlock(&reg->lock);
+}
@@ -0,0 +1,239 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+/*
+ * pepsal-stat: reader of the pepsal shared memory statistics segment.
+ * It maps the segment read-only and prints a consistent snapshot of it,
+ * optionally every @interval milliseconds along with per-second rates.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pepshm.h"
+
+/* Give up on a snapshot if the writer keeps it busy for so many tries */
+#define SNAPSHOT_RETRIES 1000
+
+static int per_thread = 0;
+
+static void usage(char *name)
+{
+		fprintf(stderr, "Usage: %s [-h] [-j] [-t] [-n shm name]"
+						" [-i interval ms] [-c count]\n", name);
+		exit(EXIT_SUCCESS);
+}
+
+static const struct pepshm_segment *map_segment(const char *name)
+{
+		const struct pepshm_segment *seg;
+		int fd;
+
+		fd = shm_open(name, O_RDONLY, 0);
+		if (fd < 0) {
+				fprintf(stderr, "Failed to open %s: %s\n", name, strerror(errno));
+				exit(EXIT_FAILURE);
+		}
+
+		seg = mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (seg == MAP_FAILED) {
+				fprintf(stderr, "Failed to map %s: %s\n", name, strerror(errno));
+				exit(EXIT_FAILURE);
+		}
+
+		if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != PEPSHM_MAGIC ||
+						seg->version != PEPSHM_VERSION || seg->size != sizeof(*seg)) {
+				fprintf(stderr, "%s: unsupported segment (version %u)\n",
+								name, seg->version);
+				exit(EXIT_FAILURE);
+		}
+
+		return seg;
+}
+
+/* Copy a consistent snapshot of @seg into @snap */
+static int snapshot(const struct pepshm_segment *seg,
+				struct pepshm_segment *snap)
+{
+		uint32_t seq1, seq2;
+		int i;
+
+		for (i = 0; i < SNAPSHOT_RETRIES; i++) {
+				seq1 = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+				if (seq1 & 1) {
+						continue;
+				}
+
+				memcpy(snap, seg, sizeof(*snap));
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				seq2 = __atomic_load_n(&seg->seq, __ATOMIC_RELAXED);
+				if (seq1 == seq2) {
+						return 0;
+				}
+		}
+
+		return -1;
+}
+
+static void print_json(struct pepshm_segment *snap, struct pepshm_segment *prev)
+{
+		double dt = 0;
+		int i, t, n;
+
+		if (prev) {
+				dt = (snap->update_ns - prev->update_ns) / 1e9;
+		}
+
+		printf("{\"pid\":%u,\"updates\":%" PRIu64 ",\"live_proxies\":%u,"
+						"\"max_conns\":%u,\"active_queue\":%u,\"ready_queue\":%u,"
+						"\"workers\":%u,\"counters\":{", snap->pid, snap->updates,
+						snap->gauges.live_proxies, snap->gauges.max_conns,
+						snap->gauges.active_queue, snap->gauges.ready_queue,
+						snap->gauges.workers);
+		for (i = 0; i < snap->nr_counters; i++) {
+				printf("%s\"%s\":%" PRIu64, i ? "," : "", snap->counter_names[i],
+								snap->totals[i]);
+		}
+		printf("}");
+
+		if (dt > 0) {
+				printf(",\"rates\":{");
+				for (i = 0; i < snap->nr_counters; i++) {
+						printf("%s\"%s\":%.f", i ? "," : "", snap->counter_names[i],
+										(snap->totals[i] - prev->totals[i]) / dt);
+				}
+				printf("}");
+		}
+
+		if (per_thread) {
+				printf(",\"threads\":[");
+				for (t = 0, n = 0; t < PEPSHM_MAX_THREADS; t++) {
+						if (!snap->threads[t].name[0]) {
+								continue;
+						}
+
+						printf("%s{\"name\":\"%.16s\"", n++ ? "," : "",
+										snap->threads[t].name);
+						for (i = 0; i < snap->nr_counters; i++) {
+								printf(",\"%s\":%" PRIu64, snap->counter_names[i],
+												snap->threads[t].counters[i]);
+						}
+						printf("}");
+				}
+				printf("]");
+		}
+		printf("}\n");
+}
+
+static void print_text(struct pepshm_segment *snap, struct pepshm_segment *prev)
+{
+		double dt = 0;
+		int i, t;
+
+		if (prev) {
+				dt = (snap->update_ns - prev->update_ns) / 1e9;
+		}
+
+		printf("pid %u, %u/%u proxies, queues active %u ready %u, %u workers\n",
+						snap->pid, snap->gauges.live_proxies, snap->gauges.max_conns,
+						snap->gauges.active_queue, snap->gauges.ready_queue,
+						snap->gauges.workers);
+		for (i = 0; i < snap->nr_counters; i++) {
+				printf("  %-24s %20" PRIu64, snap->counter_names[i], snap->totals[i]);
+				if (dt > 0) {
+						printf(" %14.f/s", (snap->totals[i] - prev->totals[i]) / dt);
+				}
+				printf("\n");
+		}
+
+		for (t = 0; per_thread && t < PEPSHM_MAX_THREADS; t++) {
+				if (!snap->threads[t].name[0]) {
+						continue;
+				}
+
+				printf("thread %.16s (slot %d)\n", snap->threads[t].name, t);
+				for (i = 0; i < snap->nr_counters; i++) {
+						if (snap->threads[t].counters[i]) {
+								printf("  %-24s %20" PRIu64 "\n", snap->counter_names[i],
+												snap->threads[t].counters[i]);
+						}
+				}
+		}
+		fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+		static struct pepshm_segment snaps[2];
+		const struct pepshm_segment *seg;
+		const char *name = PEPSHM_DEFAULT_NAME;
+		int c, json = 0, interval = 0, count = -1, n;
+		struct timespec ts;
+
+		while ((c = getopt(argc, argv, "hjtn:i:c:")) != -1) {
+				switch (c) {
+						case 'j':
+								json = 1;
+								break;
+						case 't':
+								per_thread = 1;
+								break;
+						case 'n':
+								name = optarg;
+								break;
+						case 'i':
+								interval = atoi(optarg);
+								break;
+						case 'c':
+								count = atoi(optarg);
+								break;
+						default:
+								usage(argv[0]);
+				}
+		}
+
+		if (count < 0) {
+				count = interval ? 0 : 1;
+		}
+
+		seg = map_segment(name);
+		ts.tv_sec = interval / 1000;
+		ts.tv_nsec = (interval % 1000) * 1000000L;
+		for (n = 0; !count || n < count; n++) {
+				if (snapshot(seg, &snaps[n & 1]) < 0) {
+						fprintf(stderr, "Failed to get a consistent snapshot\n");
+						return EXIT_FAILURE;
+				}
+
+				if (json) {
+						print_json(&snaps[n & 1], n ? &snaps[!(n & 1)] : NULL);
+				}
+				else {
+						print_text(&snaps[n & 1], n ? &snaps[!(n & 1)] : NULL);
+				}
+
+				if (interval > 0) {
+						nanosleep(&ts, NULL);
+				}
+		}
+
+		return EXIT_SUCCESS;
+}
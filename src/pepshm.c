@@ -0,0 +1,135 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+/*
+ * Shared memory statistics segment. A dedicated thread periodically
+ * merges per-thread counters and copies them, with a few gauges
+ * provided by pep.c, into a segment under /dev/shm. Monitoring tools
+ * map the segment read-only and poll it without any syscall into
+ * pepsal (see pepsal-stat.c for a reader).
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pepshm.h"
+#include "pepstat.h"
+
+static struct pepshm_segment *pepshm_seg = NULL;
+static pepshm_gauges_fn pepshm_gauges = NULL;
+
+int pepshm_init(const char *name, pepshm_gauges_fn gauges_fn)
+{
+		struct pepshm_segment *seg;
+		int fd, i;
+
+		if (PEPSTAT_NR > PEPSHM_MAX_COUNTERS ||
+						PEPSTAT_MAX_THREADS > PEPSHM_MAX_THREADS) {
+				errno = EOVERFLOW;
+				return -1;
+		}
+
+		shm_unlink(name);
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL,
+						S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (fd < 0) {
+				return -1;
+		}
+
+		if (ftruncate(fd, sizeof(*seg)) < 0) {
+				close(fd);
+				shm_unlink(name);
+				return -1;
+		}
+
+		seg = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE,
+						MAP_SHARED, fd, 0);
+		close(fd);
+		if (seg == MAP_FAILED) {
+				shm_unlink(name);
+				return -1;
+		}
+
+		seg->version = PEPSHM_VERSION;
+		seg->size = sizeof(*seg);
+		seg->pid = getpid();
+		seg->nr_counters = PEPSTAT_NR;
+		seg->interval_ms = PEPSHM_INTERVAL_MS;
+		seg->start_time = time(NULL);
+		for (i = 0; i < PEPSTAT_NR; i++) {
+				strncpy(seg->counter_names[i], pepstat_name(i),
+								PEPSHM_NAME_SZ - 1);
+		}
+
+		/* Readers check the magic last */
+		__atomic_store_n(&seg->magic, PEPSHM_MAGIC, __ATOMIC_RELEASE);
+
+		pepshm_seg = seg;
+		pepshm_gauges = gauges_fn;
+		return 0;
+}
+
+static void pepshm_publish(struct pepshm_segment *seg)
+{
+		struct pepshm_gauges gauges;
+		int i, id, nr_threads = 0;
+		uint64_t val;
+
+		memset(&gauges, 0, sizeof(gauges));
+		if (pepshm_gauges) {
+				pepshm_gauges(&gauges);
+		}
+
+		__atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		seg->gauges = gauges;
+		memset(seg->totals, 0, sizeof(seg->totals));
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				if (!pepstat_threads[i].used) {
+						continue;
+				}
+
+				memcpy(seg->threads[i].name, pepstat_threads[i].name,
+								sizeof(seg->threads[i].name));
+				for (id = 0; id < PEPSTAT_NR; id++) {
+						val = pepstat_threads[i].counters[id];
+						seg->threads[i].counters[id] = val;
+						seg->totals[id] += val;
+				}
+				nr_threads++;
+		}
+		seg->nr_threads = nr_threads;
+		seg->update_ns = pep_clock_ns();
+		seg->updates++;
+
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		__atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELAXED);
+}
+
+void *pepshm_loop(void UNUSED(*unused))
+{
+		struct timespec ts = {
+				PEPSHM_INTERVAL_MS / 1000,
+				(PEPSHM_INTERVAL_MS % 1000) * 1000000L
+		};
+
+		pepstat_thread_init("shm");
+		for (;;) {
+				pepshm_publish(pepshm_seg);
+				nanosleep(&ts, NULL);
+		}
+
+		return NULL;
+}
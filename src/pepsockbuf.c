@@ -0,0 +1,138 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <sys/socket.h>
+
+#include "pepsockbuf.h"
+#include "pepmem.h"
+#include "pepstat.h"
+
+/* Bandwidth-delay product of @rate bytes/s over @rtt_us microseconds */
+size_t pepsockbuf_bdp(uint64_t rate, uint64_t rtt_us)
+{
+		return rate * rtt_us / 1000000;
+}
+
+/*
+ * SO_SNDBUFFORCE/SO_RCVBUFFORCE go past net.core.wmem_max/rmem_max but
+ * need CAP_NET_ADMIN, which transparent proxying requires anyway.
+ */
+static int set_buf(int fd, int force, int opt, int size)
+{
+		if (setsockopt(fd, SOL_SOCKET, force, &size, sizeof(size)) == 0) {
+				return 0;
+		}
+
+		return setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size));
+}
+
+/*
+ * Size both buffers of @fd, currently @cur bytes each (0 if never set),
+ * for @want bytes. Growing must also fit in the global memory budget
+ * @mem_budget. Returns the new size, @cur if it was left alone.
+ *
+ * The sizes assigned over all sockets, send and receive buffers both
+ * counted, are accounted as PEPMEM_SOCKBUF. Checking them against the
+ * budget and updating them is not one atomic step, concurrent resizes
+ * may overshoot the budget by a few sockets' worth.
+ */
+int pepsockbuf_set(int fd, int cur, size_t want,
+				const struct pepsockbuf_limits *lim, size_t mem_budget)
+{
+		uint64_t used, avail;
+		size_t size = want;
+
+		if (size < lim->min) {
+				size = lim->min;
+		}
+		if (size > lim->max) {
+				size = lim->max;
+		}
+
+		if (lim->budget) {
+				used = pepmem_read(PEPMEM_SOCKBUF) - 2 * (uint64_t)cur;
+				avail = (used < lim->budget) ? (lim->budget - used) / 2 : 0;
+				if (size > avail) {
+						pepstat_inc(PEPSTAT_SOCKBUF_CAPPED);
+						if (avail < lim->min || avail <= (uint64_t)cur) {
+								return cur;
+						}
+						size = avail;
+				}
+		}
+
+		if (size > (size_t)cur && !pepmem_fits(mem_budget, 2 * (size - cur))) {
+				pepstat_inc(PEPSTAT_SOCKBUF_CAPPED);
+				return cur;
+		}
+		if (size == (size_t)cur) {
+				return cur;
+		}
+		if (set_buf(fd, SO_SNDBUFFORCE, SO_SNDBUF, size) < 0 ||
+						set_buf(fd, SO_RCVBUFFORCE, SO_RCVBUF, size) < 0) {
+				return cur;
+		}
+
+		pepmem_charge(PEPMEM_SOCKBUF, 2 * ((int64_t)size - cur));
+		pepstat_inc(PEPSTAT_SOCKBUF_RESIZES);
+		return size;
+}
+
+/* Give back the buffers of a socket sized to @size */
+void pepsockbuf_release(int size)
+{
+		if (size) {
+				pepmem_charge(PEPMEM_SOCKBUF, -2 * (int64_t)size);
+		}
+}
+
+/*
+ * Shrink both buffers of @fd to @size under memory pressure, saving
+ * their sizes in @saved for pepsockbuf_restore(). A buffer that is not
+ * larger than @size is left alone, its saved size is 0. Sizes set here
+ * are not accounted, what a socket is entitled to doesn't change.
+ */
+int pepsockbuf_shrink(int fd, int size, int saved[2])
+{
+		static const int opts[2] = { SO_SNDBUF, SO_RCVBUF };
+		static const int force[2] = { SO_SNDBUFFORCE, SO_RCVBUFFORCE };
+		socklen_t len;
+		int i, cur;
+
+		for (i = 0; i < 2; i++) {
+				saved[i] = 0;
+				len = sizeof(cur);
+				if (getsockopt(fd, SOL_SOCKET, opts[i], &cur, &len) < 0) {
+						return -1;
+				}
+
+				/* The kernel reports the doubled size */
+				cur /= 2;
+				if (cur > size && set_buf(fd, force[i], opts[i], size) == 0) {
+						saved[i] = cur;
+				}
+		}
+
+		return 0;
+}
+
+/*
+ * Give @fd back the buffer sizes saved by pepsockbuf_shrink(). Buffers
+ * the kernel used to autotune keep the size they had, as setting them
+ * disabled autotuning.
+ */
+void pepsockbuf_restore(int fd, const int saved[2])
+{
+		if (saved[0]) {
+				set_buf(fd, SO_SNDBUFFORCE, SO_SNDBUF, saved[0]);
+		}
+		if (saved[1]) {
+				set_buf(fd, SO_RCVBUFFORCE, SO_RCVBUF, saved[1]);
+		}
+}
@@ -0,0 +1,215 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "pepstat.h"
+
+/*
+ * Slot 0 is shared by the main thread and by any thread that
+ * didn't call pepstat_thread_init().
+ */
+struct pepstat_thread pepstat_threads[PEPSTAT_MAX_THREADS] = {
+		[0] = { .name = "main", .used = 1 },
+};
+__thread struct pepstat_thread *pepstat_self = &pepstat_threads[0];
+
+static int pepstat_nr_threads = 1;
+
+static const char *pepstat_names[PEPSTAT_NR] = {
+		[PEPSTAT_ACCEPTED]           = "accepted",
+		[PEPSTAT_ACCEPT_ERRORS]      = "accept_errors",
+		[PEPSTAT_DUP_SYNS]           = "duplicate_syns",
+		[PEPSTAT_CONNECTS]           = "connects",
+		[PEPSTAT_CONNECT_ERRORS]     = "connect_errors",
+		[PEPSTAT_ESTABLISHED]        = "established",
+		[PEPSTAT_DESTROYED]          = "destroyed",
+		[PEPSTAT_IO_ERRORS]          = "io_errors",
+		[PEPSTAT_BYTES_FROM_CLIENTS] = "bytes_from_clients",
+		[PEPSTAT_BYTES_FROM_SERVERS] = "bytes_from_servers",
+		[PEPSTAT_DEBUG_DROPPED]      = "debug_dropped",
+		[PEPSTAT_STALLS]             = "stalls",
+		[PEPSTAT_SOCKBUF_RESIZES]    = "sockbuf_resizes",
+		[PEPSTAT_SOCKBUF_CAPPED]     = "sockbuf_capped",
+		[PEPSTAT_THROTTLED]          = "throttled",
+		[PEPSTAT_RELAY_CAPPED]       = "relay_capped",
+		[PEPSTAT_PRESSURE_SHRINKS]   = "pressure_shrinks",
+		[PEPSTAT_PRESSURE_RESTORES]  = "pressure_restores",
+		[PEPSTAT_PACED]              = "paced",
+};
+
+static const char *pephist_names[PEPHIST_NR] = {
+		[PEPHIST_POLL_DISPATCH]    = "poll_dispatch",
+		[PEPHIST_WORKER_SERVICE]   = "worker_service",
+		[PEPHIST_READY_TURNAROUND] = "ready_turnaround",
+		[PEPHIST_ACCEPT_CONNECT]   = "accept_connect",
+		[PEPHIST_SETUP_CONNECT]    = "setup_connect",
+		[PEPHIST_SETUP_HANDSHAKE]  = "setup_handshake",
+		[PEPHIST_SETUP_CLIENT_DATA] = "setup_client_data",
+		[PEPHIST_SETUP_FORWARD]    = "setup_forward",
+		[PEPHIST_SETUP_RESPONSE]   = "setup_response",
+		[PEPHIST_SETUP_TTFB]       = "setup_ttfb",
+		[PEPHIST_STALL]            = "stall",
+};
+
+/*
+ * Give the calling thread its own statistics slot and name it
+ * @name. Returns -1 if all slots are taken, the thread then keeps
+ * sharing slot 0.
+ */
+int pepstat_thread_init(const char *name)
+{
+		char thread_name[16];
+		int idx;
+
+		snprintf(thread_name, sizeof(thread_name), "pep-%s", name);
+		pthread_setname_np(pthread_self(), thread_name);
+
+		idx = __sync_fetch_and_add(&pepstat_nr_threads, 1);
+		if (idx >= PEPSTAT_MAX_THREADS) {
+				return -1;
+		}
+
+		pepstat_self = &pepstat_threads[idx];
+		strncpy(pepstat_self->name, name, sizeof(pepstat_self->name) - 1);
+		__sync_synchronize();
+		pepstat_self->used = 1;
+		return 0;
+}
+
+const char *pepstat_name(enum pepstat_counter id)
+{
+		return pepstat_names[id];
+}
+
+/* Sum of counter @id over all threads */
+uint64_t pepstat_read(enum pepstat_counter id)
+{
+		uint64_t val = 0;
+		int i;
+
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				if (pepstat_threads[i].used) {
+						val += pepstat_threads[i].counters[id];
+				}
+		}
+
+		return val;
+}
+
+/* Dump all counters as a JSON object */
+void pepstat_dump_json(FILE *file)
+{
+		int id;
+
+		fprintf(file, "{");
+		for (id = 0; id < PEPSTAT_NR; id++) {
+				fprintf(file, "%s\"%s\":%" PRIu64, id ? "," : "",
+								pepstat_names[id], pepstat_read(id));
+		}
+		fprintf(file, "}");
+}
+
+static uint64_t pephist_bucket_max(int idx)
+{
+		int shift;
+
+		if (idx < PEPHIST_SUB) {
+				return idx;
+		}
+
+		shift = idx / PEPHIST_SUB - 1;
+		return (((uint64_t)(idx - shift * PEPHIST_SUB) + 1) << shift) - 1;
+}
+
+/* Sum per-thread buckets of histogram @id into @hist */
+void pephist_merge(enum pephist_id id, struct pephist *hist)
+{
+		int i, j;
+
+		memset(hist, 0, sizeof(*hist));
+		for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+				if (!pepstat_threads[i].used) {
+						continue;
+				}
+				for (j = 0; j < PEPHIST_BUCKETS; j++) {
+						hist->buckets[j] += pepstat_threads[i].hist[id][j];
+				}
+		}
+}
+
+/*
+ * Print percentiles of @hist as a JSON object. If @prev is not NULL,
+ * only values recorded since @prev was merged are taken into account.
+ */
+void pephist_print_json(FILE *file, struct pephist *hist, struct pephist *prev)
+{
+		static const double pcts[] = { 50.0, 90.0, 99.0, 99.9 };
+		static const char *pct_names[] = { "p50", "p90", "p99", "p999" };
+		uint64_t counts[PEPHIST_BUCKETS], total = 0, seen = 0, min = 0, max = 0;
+		double sum = 0;
+		int i, p = 0;
+
+		for (i = 0; i < PEPHIST_BUCKETS; i++) {
+				counts[i] = hist->buckets[i] - (prev ? prev->buckets[i] : 0);
+				if (!counts[i]) {
+						continue;
+				}
+				if (!total) {
+						min = (i < PEPHIST_SUB) ? (uint64_t)i :
+								pephist_bucket_max(i - 1) + 1;
+				}
+				total += counts[i];
+				max = pephist_bucket_max(i);
+				sum += (double)counts[i] * max;
+		}
+
+		fprintf(file, "{\"count\":%" PRIu64, total);
+		if (!total) {
+				fprintf(file, "}");
+				return;
+		}
+
+		fprintf(file, ",\"min\":%" PRIu64 ",\"mean\":%.f", min, sum / total);
+		for (i = 0; i < PEPHIST_BUCKETS && p < sizeof(pcts) / sizeof(pcts[0]); i++) {
+				seen += counts[i];
+				while (p < sizeof(pcts) / sizeof(pcts[0]) &&
+								seen * 100.0 >= pcts[p] * total) {
+						fprintf(file, ",\"%s\":%" PRIu64, pct_names[p],
+										pephist_bucket_max(i));
+						p++;
+				}
+		}
+		fprintf(file, ",\"max\":%" PRIu64 "}", max);
+}
+
+/*
+ * Dump all histograms as a JSON object. @prev, if not NULL, must hold
+ * PEPHIST_NR histograms: interval percentiles are printed and @prev is
+ * updated with the current values.
+ */
+void pephist_dump_json(FILE *file, struct pephist *prev)
+{
+		struct pephist hist;
+		int id;
+
+		fprintf(file, "{");
+		for (id = 0; id < PEPHIST_NR; id++) {
+				pephist_merge(id, &hist);
+				fprintf(file, "%s\"%s\":", id ? "," : "", pephist_names[id]);
+				pephist_print_json(file, &hist, prev ? &prev[id] : NULL);
+				if (prev) {
+						prev[id] = hist;
+				}
+		}
+		fprintf(file, "}");
+}
@@ -0,0 +1,124 @@
+/*
+ * PEPsal : A Performance Enhancing Proxy for Satellite Links
+ *
+ * See AUTHORS and COPYING before using this software.
+ *
+ *
+ *
+ */
+
+#include <string.h>
+#include <time.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include "pepwatch.h"
+
+uint64_t pepwatch_threshold_ns = 0;
+struct pepwatch_slot pepwatch_slots[PEPSTAT_MAX_THREADS];
+
+static struct pepwatch_offender pepwatch_recent[PEPWATCH_RECENT];
+static uint64_t pepwatch_seq = 0;
+static pthread_mutex_t pepwatch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void pepwatch_report(int thread, struct pepwatch_slot *slot,
+				uint64_t running_ns)
+{
+		struct pepwatch_offender *off;
+		char ipbuf[INET_ADDRSTRLEN];
+		struct in_addr in;
+
+		pthread_mutex_lock(&pepwatch_lock);
+		off = &pepwatch_recent[pepwatch_seq % PEPWATCH_RECENT];
+		off->seq = ++pepwatch_seq;
+		off->time = time(NULL);
+		memcpy(off->thread, pepstat_threads[thread].name, sizeof(off->thread));
+		off->call = __atomic_load_n(&slot->call, __ATOMIC_RELAXED);
+		off->addr = __atomic_load_n(&slot->addr, __ATOMIC_RELAXED);
+		off->port = __atomic_load_n(&slot->port, __ATOMIC_RELAXED);
+		off->running_ns = running_ns;
+
+		in.s_addr = htonl(off->addr);
+		inet_ntop(AF_INET, &in, ipbuf, sizeof(ipbuf));
+		fprintf(stderr, "[WARNING]: %s thread stalled for %" PRIu64
+						" ms in %s {%s:%u}\n", off->thread, running_ns / 1000000,
+						off->call ? off->call : "?", ipbuf, off->port);
+		syslog(LOG_WARNING, "%s thread stalled for %" PRIu64 " ms in %s {%s:%u}",
+						off->thread, running_ns / 1000000,
+						off->call ? off->call : "?", ipbuf, off->port);
+		pthread_mutex_unlock(&pepwatch_lock);
+}
+
+/*
+ * Print offenders reported after @last_seq as a JSON array and
+ * update @last_seq.
+ */
+void pepwatch_dump_json(FILE *file, uint64_t *last_seq)
+{
+		struct pepwatch_offender *off;
+		char ipbuf[INET_ADDRSTRLEN];
+		struct in_addr in;
+		uint64_t seq;
+		int n = 0;
+
+		pthread_mutex_lock(&pepwatch_lock);
+		seq = *last_seq;
+		if (pepwatch_seq - seq > PEPWATCH_RECENT) {
+				seq = pepwatch_seq - PEPWATCH_RECENT;
+		}
+
+		fprintf(file, "[");
+		for (; seq < pepwatch_seq; seq++) {
+				off = &pepwatch_recent[seq % PEPWATCH_RECENT];
+				in.s_addr = htonl(off->addr);
+				inet_ntop(AF_INET, &in, ipbuf, sizeof(ipbuf));
+				fprintf(file, "%s{\"time\":%ld,\"thread\":\"%s\",\"call\":\"%s\","
+								"\"src\":\"%s:%u\",\"running_ns\":%" PRIu64 "}",
+								n++ ? "," : "", (long)off->time, off->thread,
+								off->call ? off->call : "?", ipbuf, off->port,
+								off->running_ns);
+		}
+		fprintf(file, "]");
+		*last_seq = pepwatch_seq;
+		pthread_mutex_unlock(&pepwatch_lock);
+}
+
+/*
+ * Sample all threads twice per threshold. Every stalled iteration
+ * is reported once, when it is first seen running past the threshold.
+ */
+void *pepwatch_loop(void UNUSED(*unused))
+{
+		uint64_t reported[PEPSTAT_MAX_THREADS] = { 0 };
+		uint64_t start, now, interval_ns;
+		struct timespec ts;
+		int i;
+
+		pepstat_thread_init("watchdog");
+		interval_ns = pepwatch_threshold_ns / 2;
+		if (interval_ns < 1000000) {
+				interval_ns = 1000000;
+		}
+		ts.tv_sec = interval_ns / 1000000000ULL;
+		ts.tv_nsec = interval_ns % 1000000000ULL;
+
+		for (;;) {
+				nanosleep(&ts, NULL);
+				now = pep_clock_ns();
+				for (i = 0; i < PEPSTAT_MAX_THREADS; i++) {
+						start = __atomic_load_n(&pepwatch_slots[i].iter_start,
+										__ATOMIC_ACQUIRE);
+						if (!start || start == reported[i] ||
+										now - start <= pepwatch_threshold_ns) {
+								continue;
+						}
+
+						reported[i] = start;
+						pepwatch_report(i, &pepwatch_slots[i], now - start);
+				}
+		}
+
+		return NULL;
+}
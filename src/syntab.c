@@ -15,6 +15,8 @@
 #include <assert.h>
 
 #include "pepsal.h"
+#include "peprec.h"
+#include "peptrace.h"
 #include "syntab.h"
 
 struct syn_table syntab;
@@ -132,6 +134,9 @@ int syntab_add(struct pep_proxy *proxy)
 
 		list_add2tail(&syntab.conns, &proxy->lnode);
 		syntab.num_items++;
+		PEP_TRACE3(syntab_add, proxy->src.addr, proxy->src.port,
+						syntab.num_items);
+		peprec_event(PEPREC_SYNTAB_ADD, proxy, 0, syntab.num_items);
 
 		return 0;
 }
@@ -144,4 +149,16 @@ void syntab_delete(struct pep_proxy *proxy)
 		hashtable_remove(syntab.hash, &key);
 		list_del(&proxy->lnode);
 		syntab.num_items--;
+		PEP_TRACE3(syntab_delete, proxy->src.addr, proxy->src.port,
+						syntab.num_items);
+		peprec_event(PEPREC_SYNTAB_DEL, proxy, 0, syntab.num_items);
+}
+
+/* Must be called with the table locked */
+void syntab_get_stats(struct syntab_stats *stats)
+{
+		stats->entries = hashtable_count(syntab.hash);
+		stats->buckets = hashtable_chain_stats(syntab.hash,
+						&stats->used_buckets, &stats->longest_chain);
+		stats->load_factor = (double)stats->entries / stats->buckets;
 }